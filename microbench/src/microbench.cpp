@@ -0,0 +1,303 @@
+// microbenchmarks for the raycaster and rasterizer kernels in raycaster.h / raycaster.cpp,
+// built with PROFILER_ENABLED 0 and ALLOCATION_TRACKING 0 (see the project defines)
+// no window, no renderer and no SDL_Init, only the timers, so it runs on bare CI nodes
+//
+// microbench [--warmup N] [--reps N] [--filter name]
+//
+// every benchmark runs warmup + reps times, the table shows the median and fastest
+// repetition and the median TSC cycles per item (ray, pixel or call)
+#include <iostream>
+#include <algorithm>
+#include <SDL3/SDL.h>
+#include "raycaster.h"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+#define MAX_REPETITIONS 101
+#define MAX_BENCH_WIDTH 2560
+#define MAX_BENCH_HEIGHT 1664
+#define RANDOM_INPUT_COUNT 4096
+
+struct BenchConfig
+{
+	int warmup = 3;
+	int repetitions = 15;
+	const char* filter = nullptr;
+};
+
+BenchConfig config;
+volatile float benchmark_sink = 0.0f; // keeps results alive so the kernels are not optimized away
+
+inline uint64_t ReadCycles()
+{
+	return __rdtsc();
+}
+
+template <typename Fn>
+void RunBenchmark(const char* name, const char* params, double items, const char* item_name, Fn fn)
+{
+	if (config.filter && !SDL_strstr(name, config.filter))
+		return;
+
+	for (int r = 0; r < config.warmup; r++)
+	{
+		fn();
+	}
+
+	double ms[MAX_REPETITIONS];
+	double cycles[MAX_REPETITIONS];
+	for (int r = 0; r < config.repetitions; r++)
+	{
+		uint64_t start_cycles = ReadCycles();
+		uint64_t start = SDL_GetPerformanceCounter();
+		fn();
+		ms[r] = ElapsedMs(start);
+		cycles[r] = (double)(ReadCycles() - start_cycles);
+	}
+	std::sort(ms, ms + config.repetitions);
+	std::sort(cycles, cycles + config.repetitions);
+
+	int median = config.repetitions / 2;
+	char line[256];
+	SDL_snprintf(line, sizeof(line), "%-24s %-26s %10.4f %10.4f %10.2f cycles/%s\n",
+		name, params, ms[median], ms[0], cycles[median] / items, item_name);
+	std::cout << line;
+}
+
+//////////////////// Inputs /////////////////////////////
+struct BenchRay
+{
+	float x, y, dx, dy;
+	float x1, y1, x2, y2;
+};
+
+struct Pose
+{
+	float x, y, angle;
+};
+
+// spread over the open cells so no single view dominates
+const Pose poses[] =
+{
+	{ 96.0f, 96.0f, 0.0f },
+	{ 640.0f, 416.0f, 0.3f },
+	{ 160.0f, 288.0f, 1.2f },
+	{ 800.0f, 480.0f, 2.5f },
+	{ 1184.0f, 96.0f, 3.14f },
+	{ 300.0f, 600.0f, 4.0f },
+	{ 1000.0f, 300.0f, 5.0f },
+	{ 640.0f, 200.0f, 5.9f },
+};
+const int pose_count = sizeof(poses) / sizeof(poses[0]);
+
+BenchRay bench_rays[RANDOM_INPUT_COUNT];
+float bench_angles[RANDOM_INPUT_COUNT];
+uint32_t* upload_target = nullptr; // stands in for the locked texture, rows padded like a driver would
+int upload_target_pitch = 0;
+
+void BuildInputs()
+{
+	Uint64 seed = 42;
+	for (int i = 0; i < RANDOM_INPUT_COUNT; i++)
+	{
+		BenchRay& ray = bench_rays[i];
+		float angle = SDL_randf_r(&seed) * 2.0f * (float)PI;
+		ray.x = SDL_randf_r(&seed) * WINDOW_WIDTH;
+		ray.y = SDL_randf_r(&seed) * WINDOW_HEIGHT;
+		ray.dx = cosf(angle);
+		ray.dy = sinf(angle);
+		ray.x1 = SDL_randf_r(&seed) * WINDOW_WIDTH;
+		ray.y1 = SDL_randf_r(&seed) * WINDOW_HEIGHT;
+		ray.x2 = SDL_randf_r(&seed) * WINDOW_WIDTH;
+		ray.y2 = SDL_randf_r(&seed) * WINDOW_HEIGHT;
+
+		bench_angles[i] = (SDL_randf_r(&seed) - 0.5f) * 16.0f * (float)PI;
+	}
+}
+
+void SetBenchResolution(int width, int height)
+{
+	render_width = width;
+	render_height = height;
+	num_rays = width / STRIP_WIDTH;
+	color_buffer = color_buffer_memory[0];
+	color_buffer_stride = width;
+}
+/////////////////////////////////////////////////////////
+
+const int widths[] = { 320, 640, 1280, 2560 };
+
+void BenchIntersection()
+{
+	RunBenchmark("RayToLineIntersection", "random", RANDOM_INPUT_COUNT, "call", []()
+	{
+		float sum = 0.0f;
+		for (const BenchRay& ray : bench_rays)
+		{
+			auto hit = RayToLineIntersection(ray.x, ray.y, ray.dx, ray.dy, ray.x1, ray.y1, ray.x2, ray.y2);
+			sum += hit.hit ? hit.x : 0.0f;
+		}
+		benchmark_sink = sum;
+	});
+
+	RunBenchmark("NormalizeAngle", "[-8pi, 8pi]", RANDOM_INPUT_COUNT, "call", []()
+	{
+		float sum = 0.0f;
+		for (float angle : bench_angles)
+		{
+			sum += NormalizeAngle(angle);
+		}
+		benchmark_sink = sum;
+	});
+}
+
+// view distance bounds how many cells a ray may walk, the map itself is a compile time array
+void BenchCast()
+{
+	const float distances[] = { 256.0f, 640.0f, 1280.0f };
+	for (int width : widths)
+	{
+		for (float distance : distances)
+		{
+			SetBenchResolution(width, width * WINDOW_HEIGHT / WINDOW_WIDTH);
+			max_view_distance = distance;
+
+			char params[64];
+			SDL_snprintf(params, sizeof(params), "%d rays, view %.0f", num_rays, distance);
+			RunBenchmark("Ray::Cast", params, (double)num_rays * pose_count, "ray", []()
+			{
+				for (const Pose& pose : poses)
+				{
+					player.x = pose.x;
+					player.y = pose.y;
+					player.rotation_angle = pose.angle;
+					CastAllRays();
+				}
+				benchmark_sink = rays[0].min_intersection_dist;
+			});
+		}
+	}
+	max_view_distance = 1280.0f;
+}
+
+void BenchRaster()
+{
+	const char* layout_names[] = { "row", "column", "indexed" };
+	const float wall_distances[] = { 64.0f, 256.0f, 1024.0f }; // full screen, medium, far strips
+
+	for (int width : widths)
+	{
+		SetBenchResolution(width, width * WINDOW_HEIGHT / WINDOW_WIDTH);
+		double pixels = (double)render_width * render_height;
+
+		for (int layout = 0; layout < 3; layout++)
+		{
+			color_buffer_layout = layout == 1 ? ColorBufferLayout::COLUMN_MAJOR : ColorBufferLayout::ROW_MAJOR;
+			indexed_color_buffer = layout == 2;
+
+			char params[64];
+			SDL_snprintf(params, sizeof(params), "%dx%d %s", render_width, render_height, layout_names[layout]);
+			RunBenchmark("ClearColorBuffer", params, pixels, "pixel", []()
+			{
+				ClearColorBuffer(fog_color);
+			});
+
+			for (float distance : wall_distances)
+			{
+				// synthetic hits, every strip at the same distance facing the camera
+				player.rotation_angle = 0.0f;
+				for (int i = 0; i < num_rays; i++)
+				{
+					rays[i].rotation_angle = 0.0f;
+					rays[i].min_intersection_dist = distance;
+					rays[i].was_vertical_hit = i & 1;
+					rays[i].wall_type = 1;
+				}
+
+				SDL_snprintf(params, sizeof(params), "%dx%d %s d=%.0f", render_width, render_height, layout_names[layout], distance);
+				RunBenchmark("Render3DProjectWalls", params, pixels, "pixel", []()
+				{
+					Render3DProjectWalls();
+				});
+			}
+		}
+		color_buffer_layout = ColorBufferLayout::ROW_MAJOR;
+		indexed_color_buffer = false;
+
+		// the CPU half of RenderColorBuffer, what UploadColorBuffer does to the locked texture
+		char params[64];
+		SDL_snprintf(params, sizeof(params), "%dx%d row copy", render_width, render_height);
+		RunBenchmark("RenderColorBuffer", params, pixels, "pixel", []()
+		{
+			for (int y = 0; y < render_height; y++)
+			{
+				SDL_memcpy((uint8_t*)upload_target + (size_t)upload_target_pitch * y,
+					&color_buffer[(color_buffer_stride * y)], (size_t)render_width * sizeof(uint32_t));
+			}
+		});
+
+		SDL_snprintf(params, sizeof(params), "%dx%d transpose", render_width, render_height);
+		RunBenchmark("RenderColorBuffer", params, pixels, "pixel", []()
+		{
+			TransposeColorBuffer(color_buffer, upload_target, upload_target_pitch, render_width, render_height);
+		});
+
+		SDL_snprintf(params, sizeof(params), "%dx%d palette expand", render_width, render_height);
+		RunBenchmark("RenderColorBuffer", params, pixels, "pixel", []()
+		{
+			ExpandIndexedColorBuffer(IndexedColorBuffer(), upload_target, upload_target_pitch, render_width, render_height, display_palette);
+		});
+	}
+}
+
+int main(int argc, char** argv)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		if (!SDL_strcmp(argv[i], "--warmup") && i + 1 < argc)
+			config.warmup = SDL_max(SDL_atoi(argv[++i]), 0);
+		else if (!SDL_strcmp(argv[i], "--reps") && i + 1 < argc)
+			config.repetitions = SDL_clamp(SDL_atoi(argv[++i]), 1, MAX_REPETITIONS);
+		else if (!SDL_strcmp(argv[i], "--filter") && i + 1 < argc)
+			config.filter = argv[++i];
+		else
+			std::cout << "Unknown Argument: " << argv[i] << "\n";
+	}
+
+	// same buffers the game carves from its frame arena, sized for the largest run
+	size_t pixels = (size_t)MAX_BENCH_WIDTH * MAX_BENCH_HEIGHT;
+	rays = new Ray[MAX_BENCH_WIDTH / STRIP_WIDTH];
+	depth_buffer = (float*)SDL_aligned_alloc(64, sizeof(float) * MAX_BENCH_WIDTH);
+	color_buffer_memory[0] = (uint32_t*)SDL_aligned_alloc(64, sizeof(uint32_t) * pixels);
+	upload_target_pitch = (MAX_BENCH_WIDTH + 16) * (int)sizeof(uint32_t);
+	upload_target = (uint32_t*)SDL_aligned_alloc(64, (size_t)upload_target_pitch * MAX_BENCH_HEIGHT);
+	if (!depth_buffer || !color_buffer_memory[0] || !upload_target)
+	{
+		std::cout << "Failed To Allocate Benchmark Buffers!\n";
+		return 1;
+	}
+	SDL_memset(color_buffer_memory[0], 0, sizeof(uint32_t) * pixels);
+
+	BuildColormap();
+	UpdateDisplayPalette();
+	InitDoors();
+	BuildInputs();
+
+	char header[256];
+	SDL_snprintf(header, sizeof(header), "%-24s %-26s %10s %10s %10s\n", "benchmark", "params", "median ms", "min ms", "per item");
+	std::cout << header;
+
+	BenchIntersection();
+	BenchCast();
+	BenchRaster();
+
+	SDL_aligned_free(upload_target);
+	SDL_aligned_free(color_buffer_memory[0]);
+	SDL_aligned_free(depth_buffer);
+	delete[] rays;
+	return 0;
+}
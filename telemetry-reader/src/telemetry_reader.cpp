@@ -0,0 +1,242 @@
+// reads the memory mapped telemetry ring the game writes with --telemetry <file>
+// no SDL, the file is plain reads, so it works on a live game, after it exited or after it crashed
+//
+// telemetry-reader <file> [--last N] [--csv] [--follow]
+//
+// prints a summary of every frame still in the ring and the last N of them (20 by default),
+// --csv dumps every frame instead, --follow keeps printing frames as the game writes them
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include "telemetry_format.h"
+
+#define FOLLOW_POLL_MS 250
+
+struct ReaderOptions
+{
+	const char* path = nullptr;
+	int last = 20;
+	bool csv = false;
+	bool follow = false;
+};
+
+ReaderOptions options;
+
+bool ReadHeader(FILE* file, TelemetryHeader& header)
+{
+	if (fseek(file, 0, SEEK_SET) != 0 || fread(&header, sizeof(header), 1, file) != 1)
+		return false;
+
+	return !memcmp(header.magic, TELEMETRY_MAGIC, sizeof(header.magic)) && header.version == TELEMETRY_VERSION &&
+		header.header_size == sizeof(TelemetryHeader) && header.record_size == sizeof(TelemetryRecord) && header.capacity > 0;
+}
+
+// record n (1 based, as in sequence), false when it was overwritten since or torn by a crash
+bool ReadRecord(FILE* file, const TelemetryHeader& header, uint64_t n, TelemetryRecord& record)
+{
+	long long offset = (long long)header.header_size + (long long)header.record_size * (long long)((n - 1) % header.capacity);
+#ifdef _WIN32
+	if (_fseeki64(file, offset, SEEK_SET) != 0)
+#else
+	if (fseeko(file, (off_t)offset, SEEK_SET) != 0)
+#endif
+		return false;
+
+	return fread(&record, sizeof(record), 1, file) == 1 && record.sequence == n;
+}
+
+void PrintRowHeader()
+{
+	printf("%8s %10s %8s %8s %8s %8s %8s %8s %7s %11s %6s %9s %10s %7s\n",
+		"frame", "time s", "frame", "cast", "raster", "upload", "x", "y", "angle", "resolution", "allocs", "live KB", "MB touched", "sprites");
+}
+
+void PrintRow(const TelemetryHeader& header, const TelemetryRecord& record)
+{
+	char resolution[32];
+	snprintf(resolution, sizeof(resolution), "%dx%d", record.render_width, record.render_height);
+	printf("%8d %10.3f %8.3f %8.3f %8.3f %8.3f %8.1f %8.1f %7.1f %11s %6d %9lld %10.2f %7d\n",
+		record.frame, (double)(record.timestamp - header.start_counter) / (double)header.counter_frequency,
+		record.frame_ms, record.cast_ms, record.raster_ms, record.upload_ms,
+		record.x, record.y, record.angle * 57.29578f, resolution,
+		record.allocations, (long long)(record.live_bytes / 1024), record.bytes_touched / (1024.0 * 1024.0), record.visible_sprites);
+}
+
+void PrintCsvHeader()
+{
+	printf("frame,time_s,frame_ms,cast_ms,raster_ms,upload_ms,x,y,angle_degrees,render_width,render_height,resolution_scale,"
+		"allocations,live_bytes,pixels_written,bytes_touched,visible_sprites,hitch_dumps\n");
+}
+
+void PrintCsvRow(const TelemetryHeader& header, const TelemetryRecord& record)
+{
+	printf("%d,%.6f,%.4f,%.4f,%.4f,%.4f,%.3f,%.3f,%.3f,%d,%d,%.3f,%d,%lld,%lld,%lld,%d,%d\n",
+		record.frame, (double)(record.timestamp - header.start_counter) / (double)header.counter_frequency,
+		record.frame_ms, record.cast_ms, record.raster_ms, record.upload_ms,
+		record.x, record.y, record.angle * 57.29578f, record.render_width, record.render_height, record.resolution_scale,
+		record.allocations, (long long)record.live_bytes, (long long)record.pixels_written, (long long)record.bytes_touched,
+		record.visible_sprites, record.hitch_dumps);
+}
+
+// nearest rank, values are sorted, same as the game's frame time stats and benchmark report
+float Percentile(const std::vector<float>& values, float p)
+{
+	int count = (int)values.size();
+	return values[std::clamp((int)ceilf(p * count) - 1, 0, count - 1)];
+}
+
+void PrintSummary(FILE* file, const TelemetryHeader& header, uint64_t write_count)
+{
+	uint64_t first = write_count > header.capacity ? write_count - header.capacity + 1 : 1;
+	std::vector<float> frame_ms;
+	frame_ms.reserve((size_t)(write_count - first + 1));
+	int torn = 0;
+	int max_allocations = 0;
+	long long max_live_bytes = 0;
+	int hitch_dumps = 0;
+	TelemetryRecord record;
+	for (uint64_t n = first; n <= write_count; n++)
+	{
+		if (!ReadRecord(file, header, n, record))
+		{
+			torn++;
+			continue;
+		}
+		frame_ms.push_back(record.frame_ms);
+		max_allocations = std::max(max_allocations, record.allocations);
+		max_live_bytes = std::max(max_live_bytes, (long long)record.live_bytes);
+		hitch_dumps = std::max(hitch_dumps, record.hitch_dumps);
+	}
+
+	std::cout << "Telemetry: " << options.path << ", " << write_count << " frames written, " << frame_ms.size() << " in the ring";
+	if (torn)
+		std::cout << ", " << torn << " torn";
+	std::cout << "\n";
+	if (frame_ms.empty())
+		return;
+
+	double total = 0.0;
+	for (float ms : frame_ms)
+	{
+		total += ms;
+	}
+	std::sort(frame_ms.begin(), frame_ms.end());
+	printf("Frame ms: min %.3f avg %.3f p50 %.3f p95 %.3f p99 %.3f max %.3f\n",
+		frame_ms.front(), total / (double)frame_ms.size(), Percentile(frame_ms, 0.50f), Percentile(frame_ms, 0.95f),
+		Percentile(frame_ms, 0.99f), frame_ms.back());
+	printf("Peak allocations per frame %d, peak live %.2f MB, hitch dumps %d\n",
+		max_allocations, (double)max_live_bytes / (1024.0 * 1024.0), hitch_dumps);
+}
+
+// prints records (from, to], returns how many were readable
+int PrintRecords(FILE* file, const TelemetryHeader& header, uint64_t from, uint64_t to)
+{
+	if (to > header.capacity)
+		from = std::max(from, to - header.capacity);
+
+	int printed = 0;
+	TelemetryRecord record;
+	for (uint64_t n = from + 1; n <= to; n++)
+	{
+		if (!ReadRecord(file, header, n, record))
+			continue;
+		if (options.csv)
+			PrintCsvRow(header, record);
+		else
+			PrintRow(header, record);
+		printed++;
+	}
+	return printed;
+}
+
+bool ParseCommandLine(int argc, char** argv)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "--last") && i + 1 < argc)
+			options.last = std::max(atoi(argv[++i]), 0);
+		else if (!strcmp(argv[i], "--csv"))
+			options.csv = true;
+		else if (!strcmp(argv[i], "--follow"))
+			options.follow = true;
+		else if (argv[i][0] != '-' && !options.path)
+			options.path = argv[i];
+		else
+		{
+			std::cout << "Unknown Argument: " << argv[i] << "\n";
+			return false;
+		}
+	}
+	return options.path != nullptr;
+}
+
+int main(int argc, char** argv)
+{
+	if (!ParseCommandLine(argc, argv))
+	{
+		std::cout << "Usage: telemetry-reader <file> [--last N] [--csv] [--follow]\n";
+		return 1;
+	}
+
+	FILE* file = fopen(options.path, "rb");
+	if (!file)
+	{
+		std::cout << "Failed To Open " << options.path << "\n";
+		return 1;
+	}
+
+	// stdio may answer a seek back into its buffer without reading, following has to see every write
+	if (options.follow)
+		setvbuf(file, nullptr, _IONBF, 0);
+
+	TelemetryHeader header;
+	if (!ReadHeader(file, header))
+	{
+		std::cout << "Not A Telemetry File: " << options.path << "\n";
+		fclose(file);
+		return 1;
+	}
+
+	uint64_t write_count = header.write_count;
+	if (options.csv)
+	{
+		PrintCsvHeader();
+		PrintRecords(file, header, 0, write_count);
+	}
+	else
+	{
+		PrintSummary(file, header, write_count);
+		PrintRowHeader();
+		PrintRecords(file, header, write_count > (uint64_t)options.last ? write_count - options.last : 0, write_count);
+	}
+
+	while (options.follow)
+	{
+		fflush(stdout);
+		std::this_thread::sleep_for(std::chrono::milliseconds(FOLLOW_POLL_MS));
+
+		// the game may have restarted and recreated the file, skip polls that catch it half written
+		TelemetryHeader current;
+		if (!ReadHeader(file, current))
+			continue;
+		if (current.start_counter != header.start_counter || current.write_count < write_count)
+		{
+			std::cout << "Telemetry Restarted\n";
+			header = current;
+			write_count = 0;
+			continue;
+		}
+
+		PrintRecords(file, header, write_count, current.write_count);
+		write_count = current.write_count;
+	}
+
+	fclose(file);
+	return 0;
+}
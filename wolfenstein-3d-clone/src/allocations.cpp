@@ -0,0 +1,34 @@
+﻿// global operator new/delete routed through the tracked allocator, see allocations.h
+#include "allocations.h"
+
+#if ALLOCATION_TRACKING
+
+void* operator new(size_t size)
+{
+	void* memory = TrackedAlloc(size, alloc_subsystem, false);
+	if (!memory)
+		throw std::bad_alloc();
+	return memory;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	return TrackedAlloc(size, alloc_subsystem, false);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept
+{
+	return TrackedAlloc(size, alloc_subsystem, false);
+}
+
+void operator delete(void* memory) noexcept { TrackedFree(memory); }
+void operator delete[](void* memory) noexcept { TrackedFree(memory); }
+void operator delete(void* memory, size_t) noexcept { TrackedFree(memory); }
+void operator delete[](void* memory, size_t) noexcept { TrackedFree(memory); }
+
+#endif
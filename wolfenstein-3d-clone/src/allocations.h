@@ -0,0 +1,231 @@
+﻿#pragma once
+
+// heap allocation tracking: global operator new/delete, SDL (SDL_SetMemoryFunctions), ImGui
+// (SetAllocatorFunctions) and the engine's own TrackedMalloc all go through one allocator that
+// prefixes every block with its size and subsystem. counts and bytes are kept per frame and per
+// subsystem, live bytes are checked against per subsystem budgets.
+// AllocationScope tags the allocations of a block, with forbid set any allocation inside it is a
+// bug and asserts when ALLOCATION_ENFORCE is on (debug builds).
+// build with ALLOCATION_TRACKING 0 to leave the system allocators alone.
+// the operator new/delete replacements can only be defined once, they live in allocations.cpp
+#include <new>
+#include <cstdlib>
+#include <iostream>
+#include <SDL3/SDL.h>
+
+#ifndef ALLOCATION_TRACKING
+#define ALLOCATION_TRACKING 1
+#endif
+
+#ifndef ALLOCATION_ENFORCE
+#ifdef _DEBUG
+#define ALLOCATION_ENFORCE 1
+#else
+#define ALLOCATION_ENFORCE 0
+#endif
+#endif
+
+enum AllocSubsystem
+{
+	ALLOC_ENGINE, // anything untagged
+	ALLOC_CAST,
+	ALLOC_RASTER,
+	ALLOC_RENDER_TARGETS,
+	ALLOC_ASSETS,
+	ALLOC_SDL,
+	ALLOC_IMGUI,
+	ALLOC_SUBSYSTEM_COUNT
+};
+
+inline const char* alloc_subsystem_names[ALLOC_SUBSYSTEM_COUNT] = { "Engine", "Cast", "Raster", "Render Targets", "Assets", "SDL", "ImGui" };
+
+struct AllocFrameStats
+{
+	int count, bytes;
+};
+
+struct Allocations
+{
+	SDL_AtomicInt frame_count[ALLOC_SUBSYSTEM_COUNT]; // this frame so far
+	SDL_AtomicInt frame_bytes[ALLOC_SUBSYSTEM_COUNT];
+	SDL_AtomicInt live_bytes[ALLOC_SUBSYSTEM_COUNT];
+	SDL_AtomicInt violations;                         // allocations inside a forbidding scope, ever
+	AllocFrameStats last_frame[ALLOC_SUBSYSTEM_COUNT];
+	int budget_bytes[ALLOC_SUBSYSTEM_COUNT] = { 16 << 20, 0, 0, 128 << 20, 16 << 20, 16 << 20, 8 << 20 }; // live bytes, 0 allows nothing
+	bool over_budget[ALLOC_SUBSYSTEM_COUNT] = {};
+	int budget_exceeded[ALLOC_SUBSYSTEM_COUNT] = {}; // times live bytes went over, printed at exit
+	int peak_over_bytes[ALLOC_SUBSYSTEM_COUNT] = {}; // highest live bytes while over
+	bool enforce = ALLOCATION_ENFORCE;
+};
+
+inline Allocations allocations;
+
+#if ALLOCATION_TRACKING
+
+inline thread_local int alloc_subsystem = ALLOC_ENGINE;
+inline thread_local int alloc_forbidden = 0;
+
+struct AllocHeader
+{
+	uint32_t size;
+	uint32_t subsystem;
+	uint64_t pad; // keeps the block 16 byte aligned, same as malloc
+};
+
+inline SDL_malloc_func original_malloc = malloc;
+inline SDL_calloc_func original_calloc = calloc;
+inline SDL_realloc_func original_realloc = realloc;
+inline SDL_free_func original_free = free;
+
+// library allocations land in the tag of the enclosing scope if there is one
+inline int ResolveSubsystem(int fallback)
+{
+	return alloc_subsystem != ALLOC_ENGINE ? alloc_subsystem : fallback;
+}
+
+inline void CountAllocation(int subsystem, size_t size)
+{
+	SDL_AddAtomicInt(&allocations.frame_count[subsystem], 1);
+	SDL_AddAtomicInt(&allocations.frame_bytes[subsystem], (int)size);
+	SDL_AddAtomicInt(&allocations.live_bytes[subsystem], (int)size);
+
+	if (alloc_forbidden > 0)
+	{
+		SDL_AddAtomicInt(&allocations.violations, 1);
+		if (allocations.enforce)
+		{
+			// the assert handler may allocate itself
+			int forbidden = alloc_forbidden;
+			alloc_forbidden = 0;
+			SDL_assert_always(!"heap allocation inside a no-allocation scope");
+			alloc_forbidden = forbidden;
+		}
+	}
+}
+
+inline void* TrackedAlloc(size_t size, int subsystem, bool zero)
+{
+	AllocHeader* header = (AllocHeader*)(zero ? original_calloc(1, sizeof(AllocHeader) + size) : original_malloc(sizeof(AllocHeader) + size));
+	if (!header)
+		return nullptr;
+
+	header->size = (uint32_t)size;
+	header->subsystem = (uint32_t)subsystem;
+	CountAllocation(subsystem, size);
+	return header + 1;
+}
+
+inline void TrackedFree(void* memory)
+{
+	if (!memory)
+		return;
+
+	AllocHeader* header = (AllocHeader*)memory - 1;
+	SDL_AddAtomicInt(&allocations.live_bytes[header->subsystem], -(int)header->size);
+	original_free(header);
+}
+
+inline void* TrackedRealloc(void* memory, size_t size, int subsystem)
+{
+	if (!memory)
+		return TrackedAlloc(size, subsystem, false);
+
+	AllocHeader* header = (AllocHeader*)memory - 1;
+	uint32_t old_size = header->size;
+	uint32_t old_subsystem = header->subsystem;
+	header = (AllocHeader*)original_realloc(header, sizeof(AllocHeader) + size);
+	if (!header)
+		return nullptr;
+
+	SDL_AddAtomicInt(&allocations.live_bytes[old_subsystem], -(int)old_size);
+	header->size = (uint32_t)size;
+	header->subsystem = (uint32_t)subsystem;
+	CountAllocation(subsystem, size);
+	return header + 1;
+}
+
+inline void* TrackedMalloc(size_t size)
+{
+	return TrackedAlloc(size, alloc_subsystem, false);
+}
+
+inline void* SDLCALL SDLTrackedMalloc(size_t size) { return TrackedAlloc(size, ResolveSubsystem(ALLOC_SDL), false); }
+inline void* SDLCALL SDLTrackedCalloc(size_t count, size_t size) { return TrackedAlloc(count * size, ResolveSubsystem(ALLOC_SDL), true); }
+inline void* SDLCALL SDLTrackedRealloc(void* memory, size_t size) { return TrackedRealloc(memory, size, ResolveSubsystem(ALLOC_SDL)); }
+inline void SDLCALL SDLTrackedFree(void* memory) { TrackedFree(memory); }
+
+inline void* ImGuiTrackedAlloc(size_t size, void*) { return TrackedAlloc(size, ResolveSubsystem(ALLOC_IMGUI), false); }
+inline void ImGuiTrackedFree(void* memory, void*) { TrackedFree(memory); }
+
+// call first thing in main, before SDL allocates anything
+inline void InstallAllocationHooks()
+{
+	SDL_GetOriginalMemoryFunctions(&original_malloc, &original_calloc, &original_realloc, &original_free);
+	SDL_SetMemoryFunctions(SDLTrackedMalloc, SDLTrackedCalloc, SDLTrackedRealloc, SDLTrackedFree);
+}
+
+struct AllocationScope
+{
+	int previous_subsystem;
+	bool forbid;
+
+	AllocationScope(AllocSubsystem subsystem, bool forbid_allocations = false)
+		: previous_subsystem(alloc_subsystem), forbid(forbid_allocations)
+	{
+		alloc_subsystem = subsystem;
+		alloc_forbidden += forbid;
+	}
+
+	~AllocationScope()
+	{
+		alloc_subsystem = previous_subsystem;
+		alloc_forbidden -= forbid;
+	}
+};
+
+// snapshots this frame's counts and checks budgets, call once at the end of every frame.
+// overages are only recorded here, printing from the frame loop would block on the console
+inline void EndAllocationFrame()
+{
+	for (int s = 0; s < ALLOC_SUBSYSTEM_COUNT; s++)
+	{
+		allocations.last_frame[s].count = SDL_SetAtomicInt(&allocations.frame_count[s], 0);
+		allocations.last_frame[s].bytes = SDL_SetAtomicInt(&allocations.frame_bytes[s], 0);
+
+		int live = SDL_GetAtomicInt(&allocations.live_bytes[s]);
+		bool over = live > allocations.budget_bytes[s];
+		if (over && !allocations.over_budget[s])
+			allocations.budget_exceeded[s]++;
+		if (over)
+			allocations.peak_over_bytes[s] = SDL_max(allocations.peak_over_bytes[s], live);
+		allocations.over_budget[s] = over;
+	}
+}
+
+// call once the frame loop is done
+inline void ReportAllocationBudgets()
+{
+	for (int s = 0; s < ALLOC_SUBSYSTEM_COUNT; s++)
+	{
+		if (allocations.budget_exceeded[s])
+			std::cout << "Memory Budget Exceeded: " << alloc_subsystem_names[s] << " " << allocations.budget_exceeded[s] << " times, peak "
+				<< allocations.peak_over_bytes[s] << " of " << allocations.budget_bytes[s] << " bytes\n";
+	}
+}
+
+#else
+
+struct AllocationScope
+{
+	AllocationScope(AllocSubsystem, bool = false) {}
+};
+
+inline void* TrackedMalloc(size_t size) { return malloc(size); }
+inline void TrackedFree(void* memory) { free(memory); }
+inline void* ImGuiTrackedAlloc(size_t size, void*) { return malloc(size); }
+inline void ImGuiTrackedFree(void* memory, void*) { free(memory); }
+inline void InstallAllocationHooks() {}
+inline void EndAllocationFrame() {}
+inline void ReportAllocationBudgets() {}
+
+#endif
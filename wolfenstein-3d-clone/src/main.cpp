@@ -1,47 +1,14 @@
 ﻿#include <iostream>
+#include <new>
+#include <algorithm>
 #include <SDL3/SDL.h>
 #include <imgui.h>
 #include <backends/imgui_impl_sdl3.h>
 #include <backends/imgui_impl_sdlrenderer3.h>
-
-#define TILE_SIZE 64
-
-#define TILES_COL_NUM 20
-#define TILE_ROW_NUM 13
-
-#define WINDOW_WIDTH (TILES_COL_NUM * TILE_SIZE)
-#define WINDOW_HEIGHT (TILE_ROW_NUM * TILE_SIZE)
-
-#define MAP_SCALING_FACTOR 0.3f
-
-#define PI 3.14159265359
-#define TORAD 0.01745329251
-
-float FOV_ANGLE = 60.0f * TORAD;
-#define STRIP_WIDTH 1
-#define NUM_RAYS (WINDOW_WIDTH / STRIP_WIDTH)
-
-//////////////////// Map //////////////////////////////
-
-const int map[TILE_ROW_NUM][TILES_COL_NUM] = 
-{
-	{1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1},
-	{1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-	{1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-	{1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-	{1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-	{1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1},
-	{1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1},
-	{1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1},
-	{1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 0, 0, 1},
-	{1, 0, 0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-	{1, 0, 1, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-	{1, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
-	{1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1}
-};
-
-///////////////////////////////////////////////////////
-
+#include "profiler.h"
+#include "allocations.h"
+#include "raycaster.h"
+#include "telemetry.h"
 
 //////////////////// Color /////////////////////////////
 struct COLOR
@@ -58,6 +25,7 @@ COLOR YELLOW_COLOR = { 255, 255, 0, 255 };
 COLOR CYAN_COLOR = { 0, 255, 255, 255 };
 COLOR MAGENTA_COLOR = { 255, 0, 255, 255 };
 COLOR MAP_LINES_COLOR = { 87, 87, 87, 120 };
+COLOR DOOR_COLOR = { 140, 90, 43, 255 };
 
 //////////////////////////////////////////////////////
 
@@ -78,485 +46,2870 @@ void DrawOutlinedRect(SDL_Renderer* renderer,
 	SDL_RenderRect(renderer, &rect);
 }
 
+void RenderPlayer(SDL_Renderer* renderer)
+{
+	DrawOutlinedRect(renderer,
+		player.x * MAP_SCALING_FACTOR,
+		player.y * MAP_SCALING_FACTOR,
+		player.size * MAP_SCALING_FACTOR, player.size * MAP_SCALING_FACTOR,
+		RED_COLOR, WHITE_COLOR);
+
+
+	SDL_SetRenderDrawColor(renderer, 255, 0, 0, 120);
+
+	SDL_RenderLine(renderer,
+		MAP_SCALING_FACTOR * (player.x + 0.5f * player.size),
+		MAP_SCALING_FACTOR * (player.y + 0.5f * player.size),
+		MAP_SCALING_FACTOR * (player.x + cosf(player.rotation_angle) * 100),
+		MAP_SCALING_FACTOR * (player.y + sinf(player.rotation_angle) * 100));
+}
+
+void RenderRay(SDL_Renderer* renderer, const Ray& ray)
+{
+	/*
+	DrawOutlinedRect(renderer,
+		ray.intersection_x,
+		ray.intersection_y,
+		10.0f, 10.0f,
+		BLUE_COLOR, BLUE_COLOR);
+	*/
+
+	SDL_SetRenderDrawColor(renderer, 0, 0, 255, 255);
+
+	SDL_RenderLine(renderer,
+		MAP_SCALING_FACTOR * (player.x + 0.5f * player.size),
+		MAP_SCALING_FACTOR * (player.y + 0.5f * player.size),
+		MAP_SCALING_FACTOR * (ray.intersection_x),
+		MAP_SCALING_FACTOR * (ray.intersection_y));
+}
+
 //////////////////////////////////////////////////////
 
+//////////////////// Minimap ////////////////////////////
+// the tiles are rasterised once into minimap_texture at a whole number of pixels per tile,
+// after that only dirty tiles are re-rendered, the player and rays are drawn on top each frame
+
+#define MINIMAP_TILE_PIXELS ((int)(TILE_SIZE * MAP_SCALING_FACTOR))
+static_assert(MINIMAP_TILE_PIXELS == TILE_SIZE * MAP_SCALING_FACTOR, "minimap tiles must be whole pixels or the nearest filtered texture gets uneven edges");
 
-//////////////////// Player /////////////////////////////
+SDL_Texture* minimap_texture = nullptr;
 
-struct Player
+COLOR MinimapTileColor(int row, int col)
 {
-	float x = WINDOW_WIDTH * 0.5f;
-	float y = WINDOW_HEIGHT * 0.5f;
-	float size = 10.0f;
-	float rotation_angle = PI / 2.0f;
-	float walk_direction = 0; // 1 or -1 walk forward, backward
-	float turn_direction = 0; // 1 or -1 turn right, left
-	float wlak_speed = 200.0f;
-	float turn_speed = 90.0f * TORAD;
+	if (map[row][col] == DOOR_TILE)
+		return doors[door_index[row][col]].open < 1.0f ? DOOR_COLOR : BLACK_COLOR;
+	return map[row][col] == 1 ? WHITE_COLOR : BLACK_COLOR;
+}
 
-	void Update(float dt)
+void MarkMinimapDirty()
+{
+	for (int row = 0; row < TILE_ROW_NUM; row++)
 	{
-		rotation_angle += turn_speed * turn_direction * dt;
+		for (int col = 0; col < TILES_COL_NUM; col++)
+		{
+			MarkMapTileDirty(row, col);
+		}
+	}
+}
 
-		float new_x = x + cosf(rotation_angle) * wlak_speed * walk_direction * dt;
-		float new_y = y + sinf(rotation_angle) * wlak_speed * walk_direction * dt;
+void CreateMinimapTexture(SDL_Renderer* renderer)
+{
+	minimap_texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET,
+		TILES_COL_NUM * MINIMAP_TILE_PIXELS, TILE_ROW_NUM * MINIMAP_TILE_PIXELS);
+	SDL_SetTextureBlendMode(minimap_texture, SDL_BLENDMODE_BLEND);
+	SDL_SetTextureScaleMode(minimap_texture, SDL_SCALEMODE_NEAREST);
+	MarkMinimapDirty();
+}
 
-		// collision detection
-		int player_pos_at_map_col = floor((new_x + 0.5f * size) / TILE_SIZE);
-		int player_pos_at_map_raw = floor((new_y + 0.5f * size) / TILE_SIZE);
+// re-renders the dirty tiles, call before drawing the frame
+void UpdateMinimapTexture(SDL_Renderer* renderer)
+{
+	if (!map_dirty)
+		return;
 
-		if (map[player_pos_at_map_raw][player_pos_at_map_col] != 1)
+	PROFILE_SCOPE("Minimap Update");
+	SDL_Texture* previous_target = SDL_GetRenderTarget(renderer);
+	SDL_SetRenderTarget(renderer, minimap_texture);
+	for (int row = 0; row < TILE_ROW_NUM; row++)
+	{
+		for (int col = 0; col < TILES_COL_NUM; col++)
 		{
-			x = new_x;
-			y = new_y;
+			if (!map_tile_dirty[row][col])
+				continue;
+
+			DrawOutlinedRect(renderer,
+				(float)(col * MINIMAP_TILE_PIXELS), (float)(row * MINIMAP_TILE_PIXELS),
+				MINIMAP_TILE_PIXELS, MINIMAP_TILE_PIXELS,
+				MinimapTileColor(row, col), MAP_LINES_COLOR);
+			map_tile_dirty[row][col] = false;
 		}
 	}
+	SDL_SetRenderTarget(renderer, previous_target);
+	map_dirty = false;
+}
 
-	void Render(SDL_Renderer* renderer)
-	{
-		DrawOutlinedRect(renderer,
-			x * MAP_SCALING_FACTOR,
-			y * MAP_SCALING_FACTOR,
-			size * MAP_SCALING_FACTOR, size * MAP_SCALING_FACTOR,
-			RED_COLOR, WHITE_COLOR);
+void RenderMinimap(SDL_Renderer* renderer)
+{
+	PROFILE_SCOPE("Minimap");
+	SDL_FRect dst = { 0.0f, 0.0f,
+		(float)(TILES_COL_NUM * MINIMAP_TILE_PIXELS), (float)(TILE_ROW_NUM * MINIMAP_TILE_PIXELS) };
+	SDL_RenderTexture(renderer, minimap_texture, nullptr, &dst);
+}
 
+//////////////////////////////////////////////////////
 
-		SDL_SetRenderDrawColor(renderer, 255, 0, 0, 120);
 
-		SDL_RenderLine(renderer,
-			MAP_SCALING_FACTOR * (x + 0.5f * size),
-			MAP_SCALING_FACTOR * (y + 0.5f * size),
-			MAP_SCALING_FACTOR * (x + cosf(rotation_angle) * 100),
-			MAP_SCALING_FACTOR * (y + sinf(rotation_angle) * 100));
-	}
+//////////////////// RayFan /////////////////////////////
+// cold blue to hot red, scaled to the worst ray of the frame
+SDL_FColor RayHeatColor(int ray, float alpha)
+{
+	const RayStats& stats = ray_stats[ray];
+	float heat = 0.0f;
+	if (ray_heatmap == RayHeatmap::CELLS_VISITED)
+		heat = stats.cells_visited / (float)SDL_max(ray_frame_totals.max_cells_visited, 1);
+	else if (ray_heatmap == RayHeatmap::INTERSECTION_TESTS)
+		heat = stats.intersection_tests / (float)SDL_max(ray_frame_totals.max_intersection_tests, 1);
+	else if (ray_heatmap == RayHeatmap::EARLY_EXIT)
+		heat = stats.early_exit ? 1.0f : 0.0f;
+	return { heat, 0.2f * (1.0f - heat), 1.0f - heat, alpha };
+}
+
+enum class RayFanMode
+{
+	POLYGON,
+	LINES,
+	OFF,
 };
 
-Player player;
+RayFanMode ray_fan_mode = RayFanMode::POLYGON;
+int ray_fan_line_stride = 8; // LINES draws every nth ray
+SDL_Vertex* ray_fan_vertices = nullptr; // player + one per ray, carved from the frame arena
+int* ray_fan_indices = nullptr;
+SDL_FPoint* ray_fan_points = nullptr;
 
+// the whole fan in a single draw call, either the filled visibility polygon
+// or one polyline bouncing between the player and every nth ray end
+void RenderRayFan(SDL_Renderer* renderer)
+{
+	PROFILE_SCOPE("Ray Fan");
+	SDL_FPoint center = {
+		MAP_SCALING_FACTOR * (player.x + 0.5f * player.size),
+		MAP_SCALING_FACTOR * (player.y + 0.5f * player.size) };
 
+	if (ray_fan_mode == RayFanMode::POLYGON && num_rays > 1)
+	{
+		SDL_FColor color = { 0.0f, 0.0f, 1.0f, 0.35f };
+		bool heatmap = ray_stats_enabled && ray_heatmap != RayHeatmap::OFF && ray_heatmap_on_fan;
+		ray_fan_vertices[0] = { center, color, { 0.0f, 0.0f } };
+		for (int i = 0; i < num_rays; i++)
+		{
+			SDL_FPoint end = { MAP_SCALING_FACTOR * rays[i].intersection_x, MAP_SCALING_FACTOR * rays[i].intersection_y };
+			ray_fan_vertices[i + 1] = { end, heatmap ? RayHeatColor(i, 0.6f) : color, { 0.0f, 0.0f } };
+		}
+		for (int i = 0; i < num_rays - 1; i++)
+		{
+			ray_fan_indices[(3 * i) + 0] = 0;
+			ray_fan_indices[(3 * i) + 1] = i + 1;
+			ray_fan_indices[(3 * i) + 2] = i + 2;
+		}
+		SDL_RenderGeometry(renderer, nullptr, ray_fan_vertices, num_rays + 1, ray_fan_indices, 3 * (num_rays - 1));
+	}
+	else if (ray_fan_mode == RayFanMode::LINES)
+	{
+		int count = 0;
+		for (int i = 0; i < num_rays; i += ray_fan_line_stride)
+		{
+			ray_fan_points[count++] = center;
+			ray_fan_points[count++] = { MAP_SCALING_FACTOR * rays[i].intersection_x, MAP_SCALING_FACTOR * rays[i].intersection_y };
+		}
+		SDL_SetRenderDrawColor(renderer, 0, 0, 255, 255);
+		SDL_RenderLines(renderer, ray_fan_points, count);
+	}
+}
 /////////////////////////////////////////////////////////
 
-struct IntersectionData
-{
-	bool hit;
-	float x, y;
-};
+//////////////////// ColorBuffer ////////////////////////
+// ring of streaming textures so we never lock the one the renderer is still reading
+#define COLOR_BUFFER_TEXTURE_COUNT 3
 
-IntersectionData RayToLineIntersection(
-	float rx, float ry, float rdx, float rdy,
-	float x1, float y1, float x2, float y2)
+uint32_t* color_buffer_scratch = nullptr; // row-major ARGB for SDL_UpdateTexture when a texture fails to lock
+SDL_Texture* color_buffer_textures[COLOR_BUFFER_TEXTURE_COUNT] = {};
+int color_buffer_texture_index = 0;
+SDL_Texture* color_buffer_texture = nullptr;
+void* color_buffer_locked_pixels = nullptr;
+int color_buffer_locked_pitch = 0;
+float color_buffer_upload_ms = 0.0f;
+bool color_buffer_layout_auto = true;
+double color_buffer_layout_frame_ms[2] = { 0.0, 0.0 }; // measured by BenchmarkColorBufferLayouts
+bool integer_upscaling = false; // stretch by a whole factor and letterbox the rest
+
+void LockColorBufferTexture()
 {
-	IntersectionData result{ false, 0.0f, 0.0f };
+	color_buffer_texture_index = (color_buffer_texture_index + 1) % COLOR_BUFFER_TEXTURE_COUNT;
+	color_buffer_texture = color_buffer_textures[color_buffer_texture_index];
 
-	float sdx = x2 - x1;
-	float sdy = y2 - y1;
+	SDL_Rect rect = { 0, 0, render_width, render_height };
+	if (!SDL_LockTexture(color_buffer_texture, &rect, &color_buffer_locked_pixels, &color_buffer_locked_pitch))
+	{
+		color_buffer_locked_pixels = nullptr;
+	}
+}
 
-	float denom = rdx * sdy - rdy * sdx;
+// locks the next texture of the ring, must be called before drawing into color_buffer
+void LockColorBuffer()
+{
+	LockColorBufferTexture();
 
-	if (fabs(denom) < 1e-6f)
+	if (color_buffer_locked_pixels && color_buffer_layout == ColorBufferLayout::ROW_MAJOR && !indexed_color_buffer)
+	{
+		color_buffer = (uint32_t*)color_buffer_locked_pixels;
+		color_buffer_stride = color_buffer_locked_pitch / (int)sizeof(uint32_t);
+	}
+	else
 	{
-		return result;
+		color_buffer = color_buffer_memory[0];
+		color_buffer_stride = render_width;
 	}
+}
 
-	float dx = x1 - rx;
-	float dy = y1 - ry;
+void UploadColorBuffer()
+{
+	PROFILE_SCOPE("Upload");
+	uint64_t start = SDL_GetPerformanceCounter();
 
-	float t = (dx * sdy - dy * sdx) / denom;
+	// read the buffer once and write the texture once, unless the raster already drew into the texture
+	int64_t pixels_written = (int64_t)render_width * render_height;
+	if (color_buffer != color_buffer_locked_pixels || indexed_color_buffer || color_buffer_layout == ColorBufferLayout::COLUMN_MAJOR)
+		CountPass(PASS_UPLOAD, pixels_written, pixels_written * (ColorBufferBytesPerPixel() + (int)sizeof(uint32_t)));
 
-	if (t >= 0.0f) 
+	if (color_buffer_locked_pixels)
+	{
+		if (indexed_color_buffer)
+		{
+			UpdateDisplayPalette();
+			ExpandIndexedColorBuffer(IndexedColorBuffer(), (uint32_t*)color_buffer_locked_pixels, color_buffer_locked_pitch, render_width, render_height, display_palette);
+		}
+		else if (color_buffer_layout == ColorBufferLayout::COLUMN_MAJOR)
+		{
+			TransposeColorBuffer(color_buffer, (uint32_t*)color_buffer_locked_pixels, color_buffer_locked_pitch, render_width, render_height);
+		}
+		else if (color_buffer != color_buffer_locked_pixels)
+		{
+			// drawn into backing memory (pipelined frames), copy row by row to honour the pitch
+			for (int y = 0; y < render_height; y++)
+			{
+				SDL_memcpy(
+					(uint8_t*)color_buffer_locked_pixels + (size_t)color_buffer_locked_pitch * y,
+					&color_buffer[(color_buffer_stride * y)],
+					(size_t)render_width * sizeof(uint32_t));
+			}
+		}
+		SDL_UnlockTexture(color_buffer_texture);
+		color_buffer_locked_pixels = nullptr;
+	}
+	else if (indexed_color_buffer || color_buffer_layout == ColorBufferLayout::COLUMN_MAJOR)
+	{
+		// lock failed, expand or transpose into scratch memory and copy that instead
+		SDL_Rect rect = { 0, 0, render_width, render_height };
+		int pitch = render_width * (int)sizeof(uint32_t);
+		if (indexed_color_buffer)
+		{
+			UpdateDisplayPalette();
+			ExpandIndexedColorBuffer(IndexedColorBuffer(), color_buffer_scratch, pitch, render_width, render_height, display_palette);
+		}
+		else
+		{
+			TransposeColorBuffer(color_buffer, color_buffer_scratch, pitch, render_width, render_height);
+		}
+		SDL_UpdateTexture(color_buffer_texture, &rect, color_buffer_scratch, pitch);
+	}
+	else
 	{
-		result.hit = true;
-		result.x = rx + t * rdx;
-		result.y = ry + t * rdy;
+		// lock failed, fall back to copying the backing memory
+		SDL_Rect rect = { 0, 0, render_width, render_height };
+		SDL_UpdateTexture(
+			color_buffer_texture,
+			&rect,
+			color_buffer,
+			(int)((uint32_t)color_buffer_stride * sizeof(uint32_t)));
 	}
 
-	return result;
+	color_buffer_upload_ms = ElapsedMs(start);
 }
 
+// where the render_width x render_height color buffer lands in the window
+SDL_FRect ColorBufferDestRect(SDL_Renderer* renderer)
+{
+	int output_w = WINDOW_WIDTH;
+	int output_h = WINDOW_HEIGHT;
+	SDL_GetCurrentRenderOutputSize(renderer, &output_w, &output_h);
 
+	if (!integer_upscaling)
+		return { 0.0f, 0.0f, (float)output_w, (float)output_h };
 
-inline float Distance(float x1, float y1, float x2, float y2)
-{
-	float dx = x2 - x1;
-	float dy = y2 - y1;
-	return std::sqrt(dx * dx + dy * dy);
+	int factor = SDL_max(1, SDL_min(output_w / render_width, output_h / render_height));
+	int w = render_width * factor;
+	int h = render_height * factor;
+	return { (float)((output_w - w) / 2), (float)((output_h - h) / 2), (float)w, (float)h };
 }
 
-inline float NormalizeAngle(float angle)
+void RenderColorBuffer(SDL_Renderer* renderer)
 {
-	angle = fmodf(angle, 2.0f * PI);   // wrap within [-2π, 2π]
-	if (angle < 0)
-		angle += 2.0f * PI;            // shift to [0, 2π)
-	return angle;
+	UploadColorBuffer();
+
+	SDL_FRect src = { 0.0f, 0.0f, (float)render_width, (float)render_height };
+	SDL_FRect dst = ColorBufferDestRect(renderer);
+	SDL_RenderTexture(renderer, color_buffer_texture, &src, &dst);
 }
 
-//////////////////// Ray ////////////////////////////////
-struct Ray
+// times clear + walls + upload for both layouts from the current view and keeps the faster one,
+// only call while no raster job is in flight
+void BenchmarkColorBufferLayouts()
 {
-	float x, y;
-	float rotation_angle = PI / 2.0f;
+	const int frames = 32;
+	ColorBufferLayout layouts[2] = { ColorBufferLayout::ROW_MAJOR, ColorBufferLayout::COLUMN_MAJOR };
 
-	bool isRayFacingDown = 0;
-	bool isRayFacingUp = 0;
-	bool isRayFacingRight = 0;
-	bool isRayFacingLeft = 0;
+	// these rasters are not a frame, keep them out of the pass counters
+	PassCounter totals[PASS_COUNT];
+	SDL_memcpy(totals, pass_totals, sizeof(totals));
 
-	float min_intersection_dist = INFINITY;
-	float intersection_x = 0.0f;
-	float intersection_y = 0.0f;
+	CastAllRays();
 
-	bool was_vertical_hit = false;
+	for (int l = 0; l < 2; l++)
+	{
+		color_buffer_layout = layouts[l];
 
+		// warm up caches and the texture before timing
+		LockColorBuffer();
+		ClearColorBuffer(0xFF181A19);
+		Render3DProjectWalls();
+		UploadColorBuffer();
 
-	void Cast()
-	{
-		min_intersection_dist = INFINITY;
+		uint64_t start = SDL_GetPerformanceCounter();
+		for (int f = 0; f < frames; f++)
+		{
+			LockColorBuffer();
+			ClearColorBuffer(0xFF181A19);
+			Render3DProjectWalls();
+			UploadColorBuffer();
+		}
+		uint64_t end = SDL_GetPerformanceCounter();
 
-		float normalized_angle = NormalizeAngle(rotation_angle);
-		isRayFacingDown = normalized_angle > 0 && normalized_angle < PI;
-		isRayFacingUp = !isRayFacingDown;
+		color_buffer_layout_frame_ms[l] = (double)(end - start) * 1000.0 / (double)SDL_GetPerformanceFrequency() / frames;
+	}
 
-		isRayFacingRight = normalized_angle < 0.5 * PI || normalized_angle > 1.5 * PI;
-		isRayFacingLeft = !isRayFacingRight;
+	color_buffer_layout = color_buffer_layout_frame_ms[1] < color_buffer_layout_frame_ms[0] ?
+		ColorBufferLayout::COLUMN_MAJOR : ColorBufferLayout::ROW_MAJOR;
 
-		// horizontal intersections
-		for (size_t i = 0; i < TILE_ROW_NUM; i++)
-		{
-			auto hit = RayToLineIntersection(
-				x, y,
-				cosf(rotation_angle),
-				sinf(rotation_angle),
-				0.0f, TILE_SIZE * i, WINDOW_WIDTH, TILE_SIZE * i);
+	SDL_memcpy(pass_totals, totals, sizeof(totals));
+}
+/////////////////////////////////////////////////////////
 
-			if (hit.hit)
-			{
-				int col = floor(hit.x / TILE_SIZE);
-				int raw = i;
 
-				if (isRayFacingUp)
-					raw = i - 1;
+//////////////////// Sprites ////////////////////////////
+#define MAX_SPRITES 65536 // visible sprite indices are packed into 16 bits for the sort
+#define SPRITE_TEXTURE_SIZE 64
+#define SPRITE_TEXTURE_COUNT 3
+// worst cases, every texel opaque / every other texel opaque
+#define SPRITE_TEXEL_POOL_SIZE (SPRITE_TEXTURE_COUNT * SPRITE_TEXTURE_SIZE * SPRITE_TEXTURE_SIZE)
+#define SPRITE_POST_POOL_SIZE (SPRITE_TEXEL_POOL_SIZE / 2)
 
-				if (raw >= 0 && col >= 0 && raw < TILE_ROW_NUM && col < TILES_COL_NUM)
-				{
-					if (map[raw][col] != 0)
-					{
-						float dist = Distance(x, y, hit.x, hit.y);
-						if (min_intersection_dist > dist)
-						{
-							min_intersection_dist = dist;
-							intersection_x = hit.x;
-							intersection_y = hit.y;
-							was_vertical_hit = false;
-						}
-					}
-				}
-			}
-		}
+// one run of opaque texels in a sprite column, like the posts in the original VSWAP shapes
+struct SpritePost
+{
+	uint8_t start;  // first texel row
+	uint8_t length;
+	uint16_t texel; // first texel of the run, relative to the shape's texel_offset
+};
 
-		// vertical intersections
-		for (size_t i = 0; i < TILES_COL_NUM; i++)
-		{
-			auto hit = RayToLineIntersection(
-				x, y,
-				cosf(rotation_angle),
-				sinf(rotation_angle),
-				TILE_SIZE * i, 0.0f, TILE_SIZE * i, WINDOW_HEIGHT);
+// a sprite stored column by column as posts, transparent texels take no memory
+// and the drawer never has to test them
+struct SpriteShape
+{
+	uint16_t first_post[SPRITE_TEXTURE_SIZE + 1]; // column u owns posts [first_post[u], first_post[u + 1])
+	uint32_t post_offset;  // into sprite_posts
+	uint32_t texel_offset; // into sprite_texels and sprite_texel_indices
+};
 
-			if (hit.hit)
-			{
-				int raw = floor(hit.y / TILE_SIZE);
-				int col = i;
+enum SpriteFlags : uint8_t
+{
+	SPRITE_FLAG_HIDDEN = 1 << 0, // picked up, killed, ... skipped by the culler
+};
+
+// structure of arrays, the transform and cull only stream through x and y
+struct SpriteArrays
+{
+	alignas(16) float x[MAX_SPRITES];
+	alignas(16) float y[MAX_SPRITES];
+	uint16_t texture[MAX_SPRITES];
+	uint8_t flags[MAX_SPRITES];
+	int count = 0;
+};
 
-				if (isRayFacingLeft)
-					col = i - 1;
+// a sprite after projection, everything the column drawer needs
+struct VisibleSprite
+{
+	float distance;  // perpendicular, compared against depth_buffer
+	float size;      // on screen, in pixels
+	int texture;
+	int left, right; // screen columns, right exclusive, not clipped
+	int top, bottom; // not clipped
+};
 
-				if (raw >= 0 && col >= 0 && raw < TILE_ROW_NUM && col < TILES_COL_NUM)
-				{
-					if (map[raw][col] != 0)
-					{
-						float dist = Distance(x, y, hit.x, hit.y);
-						if (min_intersection_dist > dist)
-						{
-							min_intersection_dist = dist;
-							intersection_x = hit.x;
-							intersection_y = hit.y;
-							was_vertical_hit = true;
-						}
-					}
-				}
-			}
-		}
-	}
+SpriteShape sprite_shapes[SPRITE_TEXTURE_COUNT];
+SpritePost sprite_posts[SPRITE_POST_POOL_SIZE];
+uint32_t sprite_texels[SPRITE_TEXEL_POOL_SIZE];
+uint8_t sprite_texel_indices[SPRITE_TEXEL_POOL_SIZE]; // palette indices for the 8-bit color buffer
+int sprite_post_count = 0;
+int sprite_texel_count = 0;
+SpriteArrays sprites;
+VisibleSprite visible_sprites[MAX_SPRITES];
+uint32_t visible_sprite_order[MAX_SPRITES]; // indices into visible_sprites, back to front
+uint32_t sprite_sort_keys[2][MAX_SPRITES];  // radix sort ping-pong
+int visible_sprite_count = 0;
+float sprite_project_ms = 0.0f;
+int benchmark_sprite_count = 20000;
+
+// packs a column-major (pixels[(SPRITE_TEXTURE_SIZE * u) + v]) image into posts, alpha 0 is transparent
+void CookSpriteShape(SpriteShape& shape, const uint32_t* pixels)
+{
+	shape.post_offset = sprite_post_count;
+	shape.texel_offset = sprite_texel_count;
 
-	void Render(SDL_Renderer* renderer)
+	int post_count = 0;
+	int texel_count = 0;
+	for (int u = 0; u < SPRITE_TEXTURE_SIZE; u++)
 	{
-		/*
-		DrawOutlinedRect(renderer,
-			intersection_x,
-			intersection_y,
-			10.0f, 10.0f,
-			BLUE_COLOR, BLUE_COLOR);
-		*/
+		shape.first_post[u] = (uint16_t)post_count;
+		const uint32_t* column = &pixels[(SPRITE_TEXTURE_SIZE * u)];
 
-		SDL_SetRenderDrawColor(renderer, 0, 0, 255, 255);
+		for (int v = 0; v < SPRITE_TEXTURE_SIZE; )
+		{
+			if (!(column[v] >> 24))
+			{
+				v++;
+				continue;
+			}
 
-		SDL_RenderLine(renderer,
-			MAP_SCALING_FACTOR * (player.x + 0.5f * player.size),
-			MAP_SCALING_FACTOR * (player.y + 0.5f * player.size),
-			MAP_SCALING_FACTOR * (intersection_x),
-			MAP_SCALING_FACTOR * (intersection_y));
+			SpritePost& post = sprite_posts[shape.post_offset + post_count++];
+			post.start = (uint8_t)v;
+			post.texel = (uint16_t)texel_count;
+			while (v < SPRITE_TEXTURE_SIZE && (column[v] >> 24))
+			{
+				sprite_texels[shape.texel_offset + texel_count++] = column[v++];
+			}
+			post.length = (uint8_t)(v - post.start);
+		}
 	}
-};
-Ray ray;
-Ray rays[NUM_RAYS];
-/////////////////////////////////////////////////////////
+	shape.first_post[SPRITE_TEXTURE_SIZE] = (uint16_t)post_count;
 
-//////////////////// ColorBuffer ////////////////////////
-uint32_t* color_buffer = nullptr;
-SDL_Texture* color_buffer_texture = nullptr;
+	sprite_post_count += post_count;
+	sprite_texel_count += texel_count;
+}
 
-void ClearColorBuffer(uint32_t color)
+// asset cooking, loads a BMP, resamples it to SPRITE_TEXTURE_SIZE^2 and packs it into posts,
+// magenta (0xFF00FF) and alpha below half are transparent
+bool CookSpriteShapeFromBMP(SpriteShape& shape, const char* path)
 {
-	for (size_t y = 0; y < WINDOW_HEIGHT; y++)
+	SDL_Surface* loaded = SDL_LoadBMP(path);
+	if (!loaded)
+		return false;
+
+	SDL_Surface* surface = SDL_ConvertSurface(loaded, SDL_PIXELFORMAT_ARGB8888);
+	SDL_DestroySurface(loaded);
+	if (!surface)
+		return false;
+
+	uint32_t pixels[SPRITE_TEXTURE_SIZE * SPRITE_TEXTURE_SIZE];
+	for (int u = 0; u < SPRITE_TEXTURE_SIZE; u++)
 	{
-		for (size_t x = 0; x < WINDOW_WIDTH; x++)
+		int x = u * surface->w / SPRITE_TEXTURE_SIZE;
+		for (int v = 0; v < SPRITE_TEXTURE_SIZE; v++)
 		{
-			color_buffer[(WINDOW_WIDTH * y) + x] = color;
+			int y = v * surface->h / SPRITE_TEXTURE_SIZE;
+			uint32_t texel = ((const uint32_t*)((const uint8_t*)surface->pixels + (surface->pitch * y)))[x];
+			bool transparent = (texel & 0x00FFFFFF) == 0x00FF00FF || (texel >> 24) < 0x80;
+			pixels[(SPRITE_TEXTURE_SIZE * u) + v] = transparent ? 0 : (texel | 0xFF000000);
 		}
 	}
+	SDL_DestroySurface(surface);
+
+	CookSpriteShape(shape, pixels);
+	return true;
 }
 
-void RenderColorBuffer(SDL_Renderer* renderer)
+// assets/sprites/sprite<N>.bmp replaces the built in sprite N when it exists
+void BuildSpriteTextures()
 {
-	SDL_UpdateTexture(
-		color_buffer_texture,
-		nullptr,
-		color_buffer,
-		(int)((uint32_t)WINDOW_WIDTH * sizeof(uint32_t)));
+	AllocationScope alloc_scope(ALLOC_ASSETS);
+	static uint32_t pixels[SPRITE_TEXTURE_COUNT][SPRITE_TEXTURE_SIZE * SPRITE_TEXTURE_SIZE];
+	for (int u = 0; u < SPRITE_TEXTURE_SIZE; u++)
+	{
+		for (int v = 0; v < SPRITE_TEXTURE_SIZE; v++)
+		{
+			float cx = u - (SPRITE_TEXTURE_SIZE - 1) * 0.5f;
+			int texel = (SPRITE_TEXTURE_SIZE * u) + v;
+
+			// 0: stone pillar
+			bool pillar = fabsf(cx) < 10.0f || (fabsf(cx) < 14.0f && (v < 6 || v > 57));
+			pixels[0][texel] = pillar ? (fabsf(cx) < 4.0f ? 0xFF9A9A9A : 0xFF6E6E6E) : 0;
+
+			// 1: lamp, a glowing ball on a thin stand
+			float ball_dy = v - 14.0f;
+			bool ball = cx * cx + ball_dy * ball_dy < 100.0f;
+			bool stand = fabsf(cx) < 2.0f && v >= 24;
+			pixels[1][texel] = ball ? 0xFFFFE070 : (stand ? 0xFF505050 : 0);
+
+			// 2: pickup, a green gem lying on the floor
+			float gem_dy = v - 54.0f;
+			bool gem = fabsf(cx) + fabsf(gem_dy) * 1.5f < 12.0f;
+			pixels[2][texel] = gem ? (cx < 0.0f ? 0xFF30C050 : 0xFF208038) : 0;
+		}
+	}
 
-	SDL_RenderTexture(renderer, color_buffer_texture, nullptr, nullptr);
+	sprite_post_count = 0;
+	sprite_texel_count = 0;
+	for (int t = 0; t < SPRITE_TEXTURE_COUNT; t++)
+	{
+		char path[64];
+		SDL_snprintf(path, sizeof(path), "assets/sprites/sprite%d.bmp", t);
+		if (!CookSpriteShapeFromBMP(sprite_shapes[t], path))
+			CookSpriteShape(sprite_shapes[t], pixels[t]);
+	}
 }
 
-void Render3DProjectWalls(SDL_Renderer* renderer)
+// sprite colors have to be in the palette too, call after BuildColormap
+void RemapSpriteTextures()
 {
-	for (int i = 0; i < NUM_RAYS; i++)
+	for (int i = 0; i < sprite_texel_count; i++)
 	{
-		float ray_distance = rays[i].min_intersection_dist;
-		float corrected_distance = ray_distance * cosf(rays[i].rotation_angle - player.rotation_angle);
-		float distance_proj_plane = (WINDOW_WIDTH / 2) / tan(FOV_ANGLE / 2);
-		float projected_wall_height = (TILE_SIZE / corrected_distance) * distance_proj_plane;
+		sprite_texel_indices[i] = AddPaletteColor(sprite_texels[i]);
+	}
+}
 
-		int wallStripHeight = (int)projected_wall_height;
+bool AddSprite(float x, float y, int texture)
+{
+	if (sprites.count == MAX_SPRITES)
+		return false;
+
+	sprites.x[sprites.count] = x;
+	sprites.y[sprites.count] = y;
+	sprites.texture[sprites.count] = (uint16_t)texture;
+	sprites.flags[sprites.count] = 0;
+	sprites.count++;
+	return true;
+}
 
-		int wallTopPixel = (WINDOW_HEIGHT / 2) - (wallStripHeight / 2);
-		wallTopPixel = wallTopPixel < 0 ? 0 : wallTopPixel;
+void SpawnLevelSprites()
+{
+	sprites.count = 0;
+	AddSprite(5.5f * TILE_SIZE, 4.5f * TILE_SIZE, 0);
+	AddSprite(10.5f * TILE_SIZE, 6.5f * TILE_SIZE, 1);
+	AddSprite(12.5f * TILE_SIZE, 9.5f * TILE_SIZE, 2);
+	AddSprite(15.5f * TILE_SIZE, 2.5f * TILE_SIZE, 1);
+	AddSprite(4.5f * TILE_SIZE, 10.5f * TILE_SIZE, 2);
+	AddSprite(18.5f * TILE_SIZE, 5.5f * TILE_SIZE, 0);
+	AddSprite(8.5f * TILE_SIZE, 1.5f * TILE_SIZE, 0);
+	AddSprite(14.5f * TILE_SIZE, 10.5f * TILE_SIZE, 1);
+}
 
-		int wallBottomPixel = (WINDOW_HEIGHT / 2) + (wallStripHeight / 2);
-		wallBottomPixel = wallBottomPixel > WINDOW_HEIGHT ? WINDOW_HEIGHT : wallBottomPixel;
+// scatters count sprites over the open cells, the same seed always gives the same scene
+void SpawnBenchmarkSprites(int count, Uint64 seed)
+{
+	sprites.count = 0;
+	while (sprites.count < count)
+	{
+		float x = SDL_randf_r(&seed) * TILES_COL_NUM * TILE_SIZE;
+		float y = SDL_randf_r(&seed) * TILE_ROW_NUM * TILE_SIZE;
+		int texture = SDL_rand_r(&seed, SPRITE_TEXTURE_COUNT);
 
-		for (int y = wallTopPixel; y < wallBottomPixel; y++)
-		{
-			color_buffer[(WINDOW_WIDTH * y) + i] = rays[i].was_vertical_hit ? 0xFFCCCCCC : 0xFFFFFFFF;
-		}
+		if (map[(int)(y / TILE_SIZE)][(int)(x / TILE_SIZE)] == 0)
+			AddSprite(x, y, texture);
 	}
 }
-/////////////////////////////////////////////////////////
-
-
-
-uint64_t lastTime = SDL_GetTicks();
-float deltaTime = 0.0f;
 
+// camera space (depth along the view direction, side across it) -> screen columns,
+// only called for sprites that survived the frustum and distance cull
+void ProjectSprite(int index, float depth, float side, float distance_proj_plane)
+{
+	if (sprites.flags[index] & SPRITE_FLAG_HIDDEN)
+		return;
+
+	// rays are spread evenly in angle, so screen x is linear in angle too
+	float angle = atan2f(side, depth);
+	float size = (TILE_SIZE / depth) * distance_proj_plane;
+	float center_x = (angle + FOV_ANGLE / 2) / FOV_ANGLE * num_rays;
+
+	VisibleSprite& visible = visible_sprites[visible_sprite_count];
+	visible.left = (int)floorf(center_x - size * 0.5f);
+	visible.right = visible.left + (int)size;
+	if (visible.right <= 0 || visible.left >= num_rays)
+		return;
+
+	visible.distance = depth;
+	visible.size = size;
+	visible.texture = sprites.texture[index];
+	visible.top = (render_height / 2) - ((int)size / 2);
+	visible.bottom = visible.top + (int)size;
+	visible_sprite_count++;
+}
 
-int main(int argc, char** argv)
+// LSD radix sort of (quantized depth, visible index) pairs, two 8-bit passes, far to near
+void SortVisibleSprites()
 {
-	// init sdl3
-	if (!SDL_Init(SDL_INIT_VIDEO))
+	float depth_scale = 65535.0f / max_view_distance;
+	for (int i = 0; i < visible_sprite_count; i++)
 	{
-		std::cout << "Failed To Init SDL3!\n";
-		__debugbreak();
+		uint32_t depth = (uint32_t)SDL_min(visible_sprites[i].distance * depth_scale, 65535.0f);
+		sprite_sort_keys[0][i] = ((65535 - depth) << 16) | (uint32_t)i;
 	}
 
-	// create sdl window
-	auto window_falgs =
-		SDL_WINDOW_RESIZABLE |
-		SDL_WINDOW_INPUT_FOCUS;
+	uint32_t* src = sprite_sort_keys[0];
+	uint32_t* dst = sprite_sort_keys[1];
+	for (int shift = 16; shift < 32; shift += 8)
+	{
+		uint32_t offsets[256] = {};
+		for (int i = 0; i < visible_sprite_count; i++)
+		{
+			offsets[(src[i] >> shift) & 0xFF]++;
+		}
 
-	SDL_Window* window = SDL_CreateWindow("wolf 3d", WINDOW_WIDTH, WINDOW_HEIGHT, window_falgs);
+		uint32_t total = 0;
+		for (int b = 0; b < 256; b++)
+		{
+			uint32_t bucket = offsets[b];
+			offsets[b] = total;
+			total += bucket;
+		}
 
-	if (!window)
-	{
-		std::cout << "Failed To Create SDL3 Widnow!\n";
-		__debugbreak();
-	}
+		for (int i = 0; i < visible_sprite_count; i++)
+		{
+			dst[offsets[(src[i] >> shift) & 0xFF]++] = src[i];
+		}
 
-	// create renderer
-	SDL_Renderer* renderer = SDL_CreateRenderer(window, NULL);
+		uint32_t* swap = src;
+		src = dst;
+		dst = swap;
+	}
 
-	if (!renderer)
+	for (int i = 0; i < visible_sprite_count; i++)
 	{
-		std::cout << "Failed To Create SDL3 renderer!\n";
-		__debugbreak();
+		visible_sprite_order[i] = src[i] & 0xFFFF;
 	}
+}
 
-	// alpha blending
-	SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
-
+// transforms, culls and sorts against the same view the rays were cast from, call right after CastAllRays
+void ProjectSprites()
+{
+	PROFILE_SCOPE("Sprites");
+	AllocationScope alloc_scope(ALLOC_CAST, true);
+	uint64_t start = SDL_GetPerformanceCounter();
+
+	float distance_proj_plane = (render_width / 2) / tanf(FOV_ANGLE / 2);
+	float tan_half_fov = tanf(FOV_ANGLE / 2);
+	float cos_a = cosf(player.rotation_angle);
+	float sin_a = sinf(player.rotation_angle);
+	const float near_depth = 1.0f;
+	const float margin = TILE_SIZE; // sprite width, keeps sprites straddling the frustum edge
+	visible_sprite_count = 0;
+
+	int i = 0;
+#ifdef SDL_SSE2_INTRINSICS
+	const __m128 px = _mm_set1_ps(player.x);
+	const __m128 py = _mm_set1_ps(player.y);
+	const __m128 c = _mm_set1_ps(cos_a);
+	const __m128 sn = _mm_set1_ps(sin_a);
+	const __m128 near4 = _mm_set1_ps(near_depth);
+	const __m128 max_distance2 = _mm_set1_ps(max_view_distance * max_view_distance);
+	const __m128 tan4 = _mm_set1_ps(tan_half_fov);
+	const __m128 margin4 = _mm_set1_ps(margin);
+	const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+
+	for (; i + 4 <= sprites.count; i += 4)
+	{
+		__m128 dx = _mm_sub_ps(_mm_load_ps(&sprites.x[i]), px);
+		__m128 dy = _mm_sub_ps(_mm_load_ps(&sprites.y[i]), py);
+
+		__m128 depth = _mm_add_ps(_mm_mul_ps(dx, c), _mm_mul_ps(dy, sn));
+		__m128 side = _mm_sub_ps(_mm_mul_ps(dy, c), _mm_mul_ps(dx, sn));
+		__m128 distance2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+
+		// in front of the camera, inside the view distance and inside the horizontal frustum
+		__m128 visible = _mm_and_ps(_mm_cmpgt_ps(depth, near4), _mm_cmple_ps(distance2, max_distance2));
+		visible = _mm_and_ps(visible, _mm_cmple_ps(
+			_mm_sub_ps(_mm_and_ps(side, abs_mask), margin4),
+			_mm_mul_ps(depth, tan4)));
+
+		int lanes = _mm_movemask_ps(visible);
+		if (!lanes)
+			continue;
+
+		alignas(16) float depths[4];
+		alignas(16) float sides[4];
+		_mm_store_ps(depths, depth);
+		_mm_store_ps(sides, side);
+		for (int lane = 0; lane < 4; lane++)
+		{
+			if (lanes & (1 << lane))
+				ProjectSprite(i + lane, depths[lane], sides[lane], distance_proj_plane);
+		}
+	}
+#endif
+	for (; i < sprites.count; i++)
+	{
+		float dx = sprites.x[i] - player.x;
+		float dy = sprites.y[i] - player.y;
+		float depth = dx * cos_a + dy * sin_a;
+		float side = dy * cos_a - dx * sin_a;
+
+		if (depth > near_depth &&
+			dx * dx + dy * dy <= max_view_distance * max_view_distance &&
+			fabsf(side) - margin <= depth * tan_half_fov)
+		{
+			ProjectSprite(i, depth, side, distance_proj_plane);
+		}
+	}
 
-	// color buffer
-	color_buffer = (uint32_t*)malloc(sizeof(uint32_t) * (uint32_t)WINDOW_WIDTH * (uint32_t)WINDOW_HEIGHT);
-	color_buffer_texture = SDL_CreateTexture(
-		renderer,
-		SDL_PIXELFORMAT_ARGB8888,
-		SDL_TEXTUREACCESS_STREAMING,
-		WINDOW_WIDTH,
-		WINDOW_HEIGHT);
-
-	// Setup Dear ImGui context
-	IMGUI_CHECKVERSION();
-	ImGui::CreateContext();
-	ImGuiIO& io = ImGui::GetIO(); (void)io;
-
-	// Setup Dear ImGui style
-	ImGui::StyleColorsDark();
-
-	// Setup Platform/Renderer bindings
-	ImGui_ImplSDL3_InitForSDLRenderer(window, renderer);
-	ImGui_ImplSDLRenderer3_Init(renderer);
+	SortVisibleSprites();
 
-	// game loop
+	sprite_project_ms = ElapsedMs(start);
+}
 
-	SDL_Event event;
-	bool is_window_running = true;
-	while (is_window_running)
+// draws the projected sprites back to front for columns [first_column, last_column),
+// columns where a wall is nearer are skipped, transparent texels are never visited
+void Render3DProjectSpriteColumns(int first_column, int last_column)
+{
+	int64_t pixels_written = 0;
+	for (int s = 0; s < visible_sprite_count; s++)
 	{
-		uint64_t currentTime = SDL_GetTicks();
-		deltaTime = (currentTime - lastTime) / 1000.0f;
-		lastTime = currentTime;
+		const VisibleSprite& sprite = visible_sprites[visible_sprite_order[s]];
+		const SpriteShape& shape = sprite_shapes[sprite.texture];
 
+		int x_begin = SDL_max(sprite.left, first_column);
+		int x_end = SDL_min(sprite.right, last_column);
+		int y_begin = SDL_max(sprite.top, 0);
+		int y_end = SDL_min(sprite.bottom, render_height);
 
+		// 16.16 fixed point texel stepping
+		uint32_t texel_step = (uint32_t)(SPRITE_TEXTURE_SIZE * 65536.0f / sprite.size);
 
-		// poll events
-		while (SDL_PollEvent(&event))
+		for (int x = x_begin; x < x_end; x++)
 		{
-			switch (event.type)
-			{
-			case SDL_EVENT_MOUSE_MOTION:
-			{
-			}
-			break;
-			case SDL_EVENT_MOUSE_WHEEL:
-			{
-			}
-			case SDL_EVENT_KEY_DOWN:
-			{
-				if (event.key.key == SDLK_W)
-					player.walk_direction = +1;
-				if (event.key.key == SDLK_S)
-					player.walk_direction = -1;
-				if (event.key.key == SDLK_D)
-					player.turn_direction = +1;
-				if (event.key.key == SDLK_A)
-					player.turn_direction = -1;
-			}
-			break;
-			case SDL_EVENT_KEY_UP:
-			{
-				if (event.key.key == SDLK_W)
-					player.walk_direction = 0;
-				if (event.key.key == SDLK_S)
-					player.walk_direction = 0;
-				if (event.key.key == SDLK_D)
-					player.turn_direction = 0;
-				if (event.key.key == SDLK_A)
-					player.turn_direction = 0;
-			}
-			break;
-			case SDL_EVENT_WINDOW_CLOSE_REQUESTED:
+			if (sprite.distance >= depth_buffer[x])
+				continue;
+
+			int u = SDL_min((int)(((uint32_t)(x - sprite.left) * texel_step) >> 16), SPRITE_TEXTURE_SIZE - 1);
+			const SpritePost* posts = &sprite_posts[shape.post_offset];
+
+			for (int p = shape.first_post[u]; p < shape.first_post[u + 1]; p++)
 			{
-				is_window_running = false;
-			}
-			break;
-			default:
-				break;
+				const SpritePost& post = posts[p];
+
+				// first screen rows whose texel is at or past the run start / end
+				int post_top = sprite.top + (int)((((uint32_t)post.start << 16) + texel_step - 1) / texel_step);
+				int post_bottom = sprite.top + (int)((((uint32_t)(post.start + post.length) << 16) + texel_step - 1) / texel_step);
+				int y_first = SDL_max(post_top, y_begin);
+				int y_last = SDL_min(post_bottom, y_end);
+				if (y_first >= y_last)
+					continue;
+
+				uint32_t v = (uint32_t)(y_first - sprite.top) * texel_step - ((uint32_t)post.start << 16);
+				uint32_t texel_base = shape.texel_offset + post.texel;
+				pixels_written += y_last - y_first;
+				if (overdraw_view)
+					CountOverdraw(x, y_first, y_last);
+
+				if (indexed_color_buffer)
+				{
+					const uint8_t* indices = &sprite_texel_indices[texel_base];
+					uint8_t* pixels = IndexedColorBuffer();
+					for (int y = y_first; y < y_last; y++, v += texel_step)
+					{
+						pixels[(render_width * y) + x] = indices[v >> 16];
+					}
+				}
+				else if (color_buffer_layout == ColorBufferLayout::COLUMN_MAJOR)
+				{
+					const uint32_t* texels = &sprite_texels[texel_base];
+					uint32_t* column = &color_buffer[(render_height * x)];
+					for (int y = y_first; y < y_last; y++, v += texel_step)
+					{
+						column[y] = texels[v >> 16];
+					}
+				}
+				else
+				{
+					const uint32_t* texels = &sprite_texels[texel_base];
+					for (int y = y_first; y < y_last; y++, v += texel_step)
+					{
+						color_buffer[(color_buffer_stride * y) + x] = texels[v >> 16];
+					}
+				}
 			}
-
-			ImGui_ImplSDL3_ProcessEvent(&event);
 		}
+	}
+	// every pixel reads a texel of the same size as it writes
+	CountPass(PASS_SPRITES, pixels_written, 2 * pixels_written * ColorBufferBytesPerPixel());
+}
 
-		// update
-		player.Update(deltaTime);
+void Render3DProjectSprites()
+{
+	Render3DProjectSpriteColumns(0, num_rays);
+}
+/////////////////////////////////////////////////////////
 
-		// render
+//////////////////// FramePipeline //////////////////////
+// when pipelined, workers raster frame N+1 into one color_buffer_memory
+// while the main thread submits and presents frame N from the other
 
-		ImGui_ImplSDLRenderer3_NewFrame();
-		ImGui_ImplSDL3_NewFrame();
-		ImGui::NewFrame();
+#define MAX_RASTER_WORKERS 8
 
-		// clear screen
-		SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);  // black
-		SDL_RenderClear(renderer);
-		
-		// color buffer
-		ClearColorBuffer(0xFF181A19);
-		Render3DProjectWalls(renderer);
-		RenderColorBuffer(renderer);
+struct RasterWorker
+{
+	SDL_Thread* thread = nullptr;
+	SDL_Semaphore* start = nullptr;
+	int first_column = 0;
+	int last_column = 0;
+	float raster_ms = 0.0f;
+};
 
+RasterWorker raster_workers[MAX_RASTER_WORKERS];
+int raster_worker_count = 0;
+SDL_Semaphore* raster_done = nullptr;
+SDL_AtomicInt raster_workers_quit;
+bool raster_job_pending = false;
+uint32_t raster_clear_color = 0xFF181A19;
 
-		// draw map
-		for (size_t i = 0; i < TILE_ROW_NUM; i++)
-		{
-			for (size_t j = 0; j < TILES_COL_NUM; j++)
-			{
-				auto tile_color = map[i][j] == 1 ? WHITE_COLOR : BLACK_COLOR;
+bool pipelined_frames = false;
+float raster_ms = 0.0f; // whole job, the slowest worker
+bool pipelined_frame_ready = false; // color_buffer_memory[pipeline_front] holds a finished frame
+int pipeline_front = 0;
 
-				DrawOutlinedRect(renderer,
-					j * TILE_SIZE * MAP_SCALING_FACTOR,
-					i * TILE_SIZE * MAP_SCALING_FACTOR,
-					TILE_SIZE * MAP_SCALING_FACTOR, TILE_SIZE * MAP_SCALING_FACTOR,
-					tile_color, MAP_LINES_COLOR);
-			}
-		}
-		// draw player
-		player.Render(renderer);
+int RasterWorkerMain(void* data)
+{
+	RasterWorker* worker = (RasterWorker*)data;
 
-		// cast all rays
+	char name[32];
+	SDL_snprintf(name, sizeof(name), "Raster %d", (int)(worker - raster_workers));
+	ProfilerRegisterThread(name);
+
+	while (true)
+	{
+		SDL_WaitSemaphore(worker->start);
+		if (SDL_GetAtomicInt(&raster_workers_quit))
+			break;
+
+		PROFILE_SCOPE("Raster Slice");
+		AllocationScope alloc_scope(ALLOC_RASTER, true);
+		uint64_t start = SDL_GetPerformanceCounter();
+		ClearColorBufferColumns(raster_clear_color, worker->first_column, worker->last_column);
+		Render3DProjectWallColumns(worker->first_column, worker->last_column);
+		Render3DProjectSpriteColumns(worker->first_column, worker->last_column);
+		if (overdraw_view)
+			ResolveOverdrawColumns(worker->first_column, worker->last_column);
+		worker->raster_ms = ElapsedMs(start);
+
+		SDL_SignalSemaphore(raster_done);
+	}
+
+	return 0;
+}
+
+void InitRasterWorkers()
+{
+	raster_worker_count = SDL_clamp(SDL_GetNumLogicalCPUCores() - 1, 1, MAX_RASTER_WORKERS);
+	raster_done = SDL_CreateSemaphore(0);
+	SDL_SetAtomicInt(&raster_workers_quit, 0);
+
+	for (int i = 0; i < raster_worker_count; i++)
+	{
+		RasterWorker& worker = raster_workers[i];
+		worker.start = SDL_CreateSemaphore(0);
+		worker.thread = SDL_CreateThread(RasterWorkerMain, "raster worker", &worker);
+	}
+}
+
+void ShutdownRasterWorkers()
+{
+	SDL_SetAtomicInt(&raster_workers_quit, 1);
+	for (int i = 0; i < raster_worker_count; i++)
+	{
+		SDL_SignalSemaphore(raster_workers[i].start);
+		SDL_WaitThread(raster_workers[i].thread, nullptr);
+		SDL_DestroySemaphore(raster_workers[i].start);
+	}
+	SDL_DestroySemaphore(raster_done);
+	raster_worker_count = 0;
+}
+
+// workers read rays, player and color_buffer* until WaitRasterJob returns, leave them alone meanwhile
+void KickRasterJob()
+{
+	PROFILE_SCOPE("Kick Raster");
+	color_buffer = color_buffer_memory[1 - pipeline_front];
+	color_buffer_stride = render_width;
+	ResetPassCounters();
+
+	for (int i = 0; i < raster_worker_count; i++)
+	{
+		raster_workers[i].first_column = (num_rays * i) / raster_worker_count;
+		raster_workers[i].last_column = (num_rays * (i + 1)) / raster_worker_count;
+		SDL_SignalSemaphore(raster_workers[i].start);
+	}
+	raster_job_pending = true;
+}
+
+void WaitRasterJob()
+{
+	if (!raster_job_pending)
+		return;
+
+	PROFILE_SCOPE("Wait Raster");
+	for (int i = 0; i < raster_worker_count; i++)
+	{
+		SDL_WaitSemaphore(raster_done);
+	}
+	raster_job_pending = false;
+
+	raster_ms = 0.0f;
+	for (int i = 0; i < raster_worker_count; i++)
+	{
+		raster_ms = SDL_max(raster_ms, raster_workers[i].raster_ms);
+	}
+
+	// the finished back buffer becomes the frame to present
+	pipeline_front = 1 - pipeline_front;
+	pipelined_frame_ready = true;
+}
+
+void RenderPipelinedColorBuffer(SDL_Renderer* renderer)
+{
+	if (!pipelined_frame_ready)
+	{
+		// first pipelined frame, nothing in flight yet
+		KickRasterJob();
+		WaitRasterJob();
+	}
+
+	LockColorBufferTexture();
+	color_buffer = color_buffer_memory[pipeline_front];
+	color_buffer_stride = render_width;
+	RenderColorBuffer(renderer);
+}
+/////////////////////////////////////////////////////////
+
+//////////////////// LayoutSelect ///////////////////////
+// the auto layout pick per render size, measured once a size has held for LAYOUT_SETTLE_FRAMES
+// so dragging the window edge or a resolution governor step never stalls on a benchmark
+#define LAYOUT_CACHE_SIZE 16
+#define LAYOUT_SETTLE_FRAMES 30
+
+struct LayoutChoice
+{
+	int width, height;
+	ColorBufferLayout layout;
+	double frame_ms[2];
+};
+
+LayoutChoice layout_choices[LAYOUT_CACHE_SIZE];
+int layout_choice_count = 0;  // ever stored, the oldest is replaced once full
+int layout_settle_frames = 0; // frames until the current render size may be measured
+
+// call once per frame while no raster job is in flight
+void SelectColorBufferLayout()
+{
+	// the 8-bit buffer is always row major, there is nothing to pick
+	if (!color_buffer_layout_auto || indexed_color_buffer)
+		return;
+
+	for (int i = 0; i < SDL_min(layout_choice_count, LAYOUT_CACHE_SIZE); i++)
+	{
+		const LayoutChoice& choice = layout_choices[i];
+		if (choice.width == render_width && choice.height == render_height)
+		{
+			if (choice.layout != color_buffer_layout)
+				pipelined_frame_ready = false; // drawn in the other layout
+			color_buffer_layout = choice.layout;
+			color_buffer_layout_frame_ms[0] = choice.frame_ms[0];
+			color_buffer_layout_frame_ms[1] = choice.frame_ms[1];
+			return;
+		}
+	}
+
+	if (layout_settle_frames > 0)
+	{
+		layout_settle_frames--;
+		return;
+	}
+
+	// the benchmark draws through color_buffer_memory, which may hold the pipelined frame
+	BenchmarkColorBufferLayouts();
+	pipelined_frame_ready = false;
+	layout_choices[layout_choice_count++ % LAYOUT_CACHE_SIZE] = {
+		render_width, render_height, color_buffer_layout,
+		{ color_buffer_layout_frame_ms[0], color_buffer_layout_frame_ms[1] } };
+}
+/////////////////////////////////////////////////////////
+
+//////////////////// ResolutionGovernor /////////////////
+// scales the internal resolution (ray count and rows) to keep cast + raster inside
+// a frame time budget, the color buffer is stretched back to the window on present
+
+struct ResolutionGovernor
+{
+	bool enabled = false;
+	float budget_ms = 8.3f;
+	float scale = 1.0f;       // fraction of the output resolution on both axes
+	float base_scale = 1.0f;  // 1 / pixel density, renders at the window's logical size
+	float min_scale = 0.25f;
+	float cost_ms = 0.0f;     // smoothed cast + raster time
+	int frames_since_change = 0;
+
+	float StepScale(int direction)
+	{
+		if (integer_upscaling)
+		{
+			int divisor = (int)roundf(1.0f / scale) - direction;
+			return 1.0f / SDL_clamp(divisor, 1, (int)(1.0f / min_scale));
+		}
+		return SDL_clamp(scale + direction * 0.0625f, min_scale, 1.0f);
+	}
+
+	float Update(float frame_cost_ms)
+	{
+		cost_ms = cost_ms == 0.0f ? frame_cost_ms : cost_ms + (frame_cost_ms - cost_ms) * 0.1f;
+
+		// native pixel density (above base_scale) is only reached when the budget allows it
+		if (!enabled)
+		{
+			scale = base_scale;
+			return scale;
+		}
+
+		// hysteresis: let a change settle before judging it, and only scale back up
+		// once there is clear headroom
+		if (++frames_since_change < 15)
+			return scale;
+
+		float new_scale = scale;
+		if (cost_ms > budget_ms)
+			new_scale = StepScale(-1);
+		else if (cost_ms < budget_ms * 0.7f)
+			new_scale = StepScale(+1);
+
+		if (new_scale != scale)
+		{
+			scale = new_scale;
+			frames_since_change = 0;
+			cost_ms = 0.0f;
+		}
+		return scale;
+	}
+};
+
+ResolutionGovernor resolution_governor;
+
+// only call while no raster job is in flight
+void SetRenderResolution(float scale)
+{
+	int width = SDL_clamp((int)(output_width * scale), STRIP_WIDTH, output_width);
+	int height = SDL_clamp((int)(output_height * scale), 1, output_height);
+	if (width == render_width && height == render_height)
+		return;
+
+	render_width = width;
+	render_height = height;
+	num_rays = render_width / STRIP_WIDTH;
+
+	// the pipelined frame and last frame's rays were made for the old size
+	pipelined_frame_ready = false;
+	layout_settle_frames = LAYOUT_SETTLE_FRAMES;
+	CastAllRays();
+	ProjectSprites();
+}
+/////////////////////////////////////////////////////////
+
+//////////////////// RayInspector ///////////////////////
+// per ray stats on screen: a heatmap strip per column over the 3D view, the cells the
+// inspected ray visited outlined on the minimap, and its full traversal in a window
+
+SDL_Vertex* ray_heatmap_vertices = nullptr; // top and bottom per ray, carved from the frame arena
+int* ray_heatmap_indices = nullptr;
+SDL_FRect ray_trace_rects[MAX_RAY_TRACE_STEPS];
+
+const char* ray_exit_names[] = { "Wall", "Door", "Fog", "Beaten", "Map Edge" };
+
+// one draw call, neighbouring columns blend into each other
+void RenderRayHeatmap(SDL_Renderer* renderer)
+{
+	if (!ray_stats_enabled || num_rays < 2)
+		return;
+
+	SDL_FRect dst = ColorBufferDestRect(renderer);
+	float column_width = dst.w / num_rays;
+	if (ray_heatmap != RayHeatmap::OFF && ray_heatmap_on_view)
+	{
+		for (int i = 0; i < num_rays; i++)
+		{
+			SDL_FColor color = RayHeatColor(i, 0.45f);
+			float x = dst.x + (i + 0.5f) * column_width;
+			ray_heatmap_vertices[(2 * i) + 0] = { { x, dst.y }, color, { 0.0f, 0.0f } };
+			ray_heatmap_vertices[(2 * i) + 1] = { { x, dst.y + dst.h }, color, { 0.0f, 0.0f } };
+		}
+		for (int i = 0; i < num_rays - 1; i++)
+		{
+			int* quad = &ray_heatmap_indices[6 * i];
+			quad[0] = (2 * i) + 0; quad[1] = (2 * i) + 1; quad[2] = (2 * i) + 2;
+			quad[3] = (2 * i) + 2; quad[4] = (2 * i) + 1; quad[5] = (2 * i) + 3;
+		}
+		SDL_RenderGeometry(renderer, nullptr, ray_heatmap_vertices, 2 * num_rays, ray_heatmap_indices, 6 * (num_rays - 1));
+	}
+
+	if (inspected_ray >= 0 && inspected_ray < num_rays)
+	{
+		float x = dst.x + (inspected_ray + 0.5f) * column_width;
+		SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+		SDL_RenderLine(renderer, x, dst.y, x, dst.y + dst.h);
+	}
+}
+
+void RenderRayTrace(SDL_Renderer* renderer)
+{
+	if (!ray_stats_enabled || inspected_ray < 0 || inspected_ray >= num_rays)
+		return;
+
+	for (int i = 0; i < ray_trace.count; i++)
+	{
+		const RayTraceStep& step = ray_trace.steps[i];
+		ray_trace_rects[i] = {
+			MAP_SCALING_FACTOR * step.col * TILE_SIZE, MAP_SCALING_FACTOR * step.raw * TILE_SIZE,
+			MAP_SCALING_FACTOR * TILE_SIZE, MAP_SCALING_FACTOR * TILE_SIZE };
+	}
+	SDL_SetRenderDrawColor(renderer, 255, 255, 0, 255);
+	SDL_RenderRects(renderer, ray_trace_rects, ray_trace.count);
+
+	SDL_RenderLine(renderer,
+		MAP_SCALING_FACTOR * (player.x + 0.5f * player.size),
+		MAP_SCALING_FACTOR * (player.y + 0.5f * player.size),
+		MAP_SCALING_FACTOR * rays[inspected_ray].intersection_x,
+		MAP_SCALING_FACTOR * rays[inspected_ray].intersection_y);
+}
+
+// window coordinates of a click on the 3D view to the ray drawn in that column
+void InspectRayAt(SDL_Renderer* renderer, float window_x, float window_y)
+{
+	float x = 0.0f, y = 0.0f;
+	SDL_RenderCoordinatesFromWindow(renderer, window_x, window_y, &x, &y);
+	SDL_FRect dst = ColorBufferDestRect(renderer);
+	if (x < dst.x || x >= dst.x + dst.w || y < dst.y || y >= dst.y + dst.h)
+		return;
+
+	inspected_ray = SDL_clamp((int)((x - dst.x) / dst.w * num_rays), 0, num_rays - 1);
+}
+
+void DrawRayInspectorWindow()
+{
+	if (!ray_stats_enabled || inspected_ray < 0 || inspected_ray >= num_rays)
+		return;
+
+	ImGui::Begin("Ray Inspector");
+	const Ray& ray = rays[inspected_ray];
+	const RayStats& stats = ray_stats[inspected_ray];
+	ImGui::Text("Ray %d of %d, angle %.2f deg", inspected_ray, num_rays, NormalizeAngle(ray.rotation_angle) / TORAD);
+	ImGui::Text("Hit (%.1f, %.1f) at %.1f, %s%s", ray.intersection_x, ray.intersection_y, ray.min_intersection_dist,
+		ray.was_fogged ? "fogged" : (ray.was_vertical_hit ? "vertical" : "horizontal"), ray.wall_type == DOOR_TILE ? " door" : "");
+	ImGui::Text("Cells Visited: %d  Intersection Tests: %d  Pixels: %d", stats.cells_visited, stats.intersection_tests, stats.pixels);
+	ImGui::Text("Horizontal Exit: %s  Vertical Exit: %s%s", ray_exit_names[(int)stats.horizontal_exit], ray_exit_names[(int)stats.vertical_exit],
+		stats.early_exit ? "  (early)" : "");
+	if (ImGui::Button("Clear"))
+		inspected_ray = -1;
+
+	if (ImGui::BeginTable("##ray_trace", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY, { 0.0f, 200.0f }))
+	{
+		ImGui::TableSetupColumn("Pass");
+		ImGui::TableSetupColumn("Row");
+		ImGui::TableSetupColumn("Col");
+		ImGui::TableSetupColumn("Distance");
+		ImGui::TableSetupColumn("Cell");
+		ImGui::TableHeadersRow();
+		for (int i = 0; i < ray_trace.count; i++)
+		{
+			const RayTraceStep& step = ray_trace.steps[i];
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn(); ImGui::TextUnformatted(step.vertical ? "Vertical" : "Horizontal");
+			ImGui::TableNextColumn(); ImGui::Text("%d", step.raw);
+			ImGui::TableNextColumn(); ImGui::Text("%d", step.col);
+			ImGui::TableNextColumn(); ImGui::Text("%.1f", step.dist);
+			ImGui::TableNextColumn();
+			if (step.cell == DOOR_TILE)
+				ImGui::TextUnformatted(step.door_hit ? "Door (hit)" : "Door (open)");
+			else if (step.cell != 0)
+				ImGui::Text("Wall %d", step.cell);
+			else
+				ImGui::TextUnformatted("Empty");
+		}
+		ImGui::EndTable();
+	}
+	ImGui::End();
+}
+/////////////////////////////////////////////////////////
+
+//////////////////// RenderTargets //////////////////////
+// every buffer whose size follows the window is carved from one arena that only
+// grows, a resize re-carves it and steady state frames never touch the heap
+
+struct FrameArena
+{
+	uint8_t* memory = nullptr;
+	size_t capacity = 0;
+	size_t used = 0;
+
+	void Reset(size_t size)
+	{
+		if (size > capacity)
+		{
+			TrackedFree(memory);
+			memory = (uint8_t*)TrackedMalloc(size);
+			capacity = size;
+		}
+		used = 0;
+	}
+
+	void* Push(size_t size, size_t alignment = 64)
+	{
+		size_t offset = (used + alignment - 1) & ~(alignment - 1);
+		SDL_assert(offset + size <= capacity);
+		used = offset + size;
+		return memory + offset;
+	}
+
+	void Release()
+	{
+		TrackedFree(memory);
+		memory = nullptr;
+		capacity = 0;
+		used = 0;
+	}
+};
+
+FrameArena frame_arena;
+bool fixed_internal_resolution = false; // keep WINDOW_WIDTH x WINDOW_HEIGHT and let the window scale it
+bool render_targets_dirty = false;      // set when an option needs ApplyWindowSize next frame
+
+// only call while no raster job is in flight
+void ResizeRenderTargets(SDL_Renderer* renderer, int width, int height)
+{
+	AllocationScope alloc_scope(ALLOC_RENDER_TARGETS);
+	output_width = width;
+	output_height = height;
+
+	size_t ray_count = (size_t)(width / STRIP_WIDTH);
+	size_t ray_bytes = sizeof(Ray) * ray_count;
+	size_t fan_vertex_bytes = sizeof(SDL_Vertex) * (ray_count + 1);
+	size_t fan_index_bytes = sizeof(int) * 3 * ray_count;
+	size_t fan_point_bytes = sizeof(SDL_FPoint) * 2 * ray_count;
+	size_t ray_stats_bytes = sizeof(RayStats) * ray_count;
+	size_t heatmap_vertex_bytes = sizeof(SDL_Vertex) * 2 * ray_count;
+	size_t heatmap_index_bytes = sizeof(int) * 6 * ray_count;
+	size_t depth_bytes = sizeof(float) * (size_t)width;
+	size_t color_bytes = sizeof(uint32_t) * (size_t)width * (size_t)height;
+	size_t overdraw_bytes = (size_t)width * (size_t)height;
+	frame_arena.Reset(ray_bytes + fan_vertex_bytes + fan_index_bytes + fan_point_bytes + ray_stats_bytes +
+		heatmap_vertex_bytes + heatmap_index_bytes + depth_bytes + 3 * color_bytes + overdraw_bytes + 12 * 64);
+
+	rays = (Ray*)frame_arena.Push(ray_bytes);
+	for (int i = 0; i < width / STRIP_WIDTH; i++)
+	{
+		new (&rays[i]) Ray();
+	}
+	ray_fan_vertices = (SDL_Vertex*)frame_arena.Push(fan_vertex_bytes);
+	ray_fan_indices = (int*)frame_arena.Push(fan_index_bytes);
+	ray_fan_points = (SDL_FPoint*)frame_arena.Push(fan_point_bytes);
+	ray_stats = (RayStats*)frame_arena.Push(ray_stats_bytes);
+	SDL_memset(ray_stats, 0, ray_stats_bytes);
+	ray_heatmap_vertices = (SDL_Vertex*)frame_arena.Push(heatmap_vertex_bytes);
+	ray_heatmap_indices = (int*)frame_arena.Push(heatmap_index_bytes);
+	depth_buffer = (float*)frame_arena.Push(depth_bytes);
+	overdraw_buffer = (uint8_t*)frame_arena.Push(overdraw_bytes);
+	for (int i = 0; i < 2; i++)
+	{
+		color_buffer_memory[i] = (uint32_t*)frame_arena.Push(color_bytes);
+	}
+	color_buffer_scratch = (uint32_t*)frame_arena.Push(color_bytes);
+
+	for (int i = 0; i < COLOR_BUFFER_TEXTURE_COUNT; i++)
+	{
+		if (color_buffer_textures[i])
+			SDL_DestroyTexture(color_buffer_textures[i]);
+
+		color_buffer_textures[i] = SDL_CreateTexture(
+			renderer,
+			SDL_PIXELFORMAT_ARGB8888,
+			SDL_TEXTUREACCESS_STREAMING,
+			width,
+			height);
+		SDL_SetTextureScaleMode(color_buffer_textures[i], SDL_SCALEMODE_NEAREST);
+	}
+
+	// force SetRenderResolution to recompute everything for the new size
+	render_width = 0;
+	inspected_ray = -1;
+	render_height = 0;
+	SetRenderResolution(resolution_governor.scale);
+}
+
+void ApplyWindowSize(SDL_Window* window, SDL_Renderer* renderer)
+{
+	int width = WINDOW_WIDTH;
+	int height = WINDOW_HEIGHT;
+	float density = 1.0f;
+
+	if (!fixed_internal_resolution && window)
+	{
+		SDL_GetWindowSizeInPixels(window, &width, &height);
+		density = SDL_max(SDL_GetWindowPixelDensity(window), 1.0f);
+	}
+
+	resolution_governor.base_scale = 1.0f / density;
+	if (!resolution_governor.enabled)
+		resolution_governor.scale = resolution_governor.base_scale;
+
+	if (width != output_width || height != output_height || !rays)
+		ResizeRenderTargets(renderer, width, height);
+	else
+		SetRenderResolution(resolution_governor.scale);
+}
+/////////////////////////////////////////////////////////
+
+
+
+uint64_t lastTime = SDL_GetPerformanceCounter();
+float deltaTime = 0.0f;
+float cast_ms = 0.0f;     // rays + sprite projection
+float ray_cast_ms = 0.0f; // rays alone
+
+//////////////////// FrameTimes /////////////////////////
+// wall clock time between frames from the performance counter, kept in a ring of the last
+// FRAME_TIME_HISTORY frames. this is what the debug window reports instead of 1 / deltaTime
+
+#define FRAME_TIME_HISTORY 512
+#define FRAME_TIME_BUCKETS 48
+
+struct FrameTimeStats
+{
+	float min_ms, avg_ms, p50_ms, p99_ms, max_ms;
+	int over_budget; // in the ring
+};
+
+float frame_times[FRAME_TIME_HISTORY];
+int frame_time_count = 0; // frames ever recorded, the next goes to frame_time_count % FRAME_TIME_HISTORY
+float frame_budget_ms = 1000.0f / 60.0f;
+int frames_over_budget = 0; // since the last reset
+
+void RecordFrameTime(float ms)
+{
+	frame_times[frame_time_count % FRAME_TIME_HISTORY] = ms;
+	frame_time_count++;
+	if (ms > frame_budget_ms)
+		frames_over_budget++;
+}
+
+void ResetFrameTimes()
+{
+	frame_time_count = 0;
+	frames_over_budget = 0;
+}
+
+FrameTimeStats ComputeFrameTimeStats()
+{
+	FrameTimeStats stats = {};
+	int count = SDL_min(frame_time_count, FRAME_TIME_HISTORY);
+	if (count == 0)
+		return stats;
+
+	float sorted[FRAME_TIME_HISTORY];
+	double sum = 0.0;
+	for (int i = 0; i < count; i++)
+	{
+		sorted[i] = frame_times[i];
+		sum += frame_times[i];
+		stats.over_budget += frame_times[i] > frame_budget_ms;
+	}
+	std::sort(sorted, sorted + count);
+
+	// nearest rank, same as the benchmark report
+	auto percentile = [&](float p) { return sorted[SDL_clamp((int)SDL_ceilf(p * count) - 1, 0, count - 1)]; };
+	stats.min_ms = sorted[0];
+	stats.max_ms = sorted[count - 1];
+	stats.avg_ms = (float)(sum / count);
+	stats.p50_ms = percentile(0.50f);
+	stats.p99_ms = percentile(0.99f);
+	return stats;
+}
+
+void DrawFrameTimes()
+{
+	int count = SDL_min(frame_time_count, FRAME_TIME_HISTORY);
+	FrameTimeStats stats = ComputeFrameTimeStats();
+
+	ImGui::Text("Frame: %.3f ms (%.1f FPS avg)", count ? frame_times[(frame_time_count - 1) % FRAME_TIME_HISTORY] : 0.0f,
+		stats.avg_ms > 0.0f ? 1000.0f / stats.avg_ms : 0.0f);
+	ImGui::Text("Min %.3f  Avg %.3f  P50 %.3f  P99 %.3f  Max %.3f ms",
+		stats.min_ms, stats.avg_ms, stats.p50_ms, stats.p99_ms, stats.max_ms);
+	ImGui::Text("Over Budget: %d of last %d, %d total", stats.over_budget, count, frames_over_budget);
+	ImGui::SliderFloat("Frame Budget (ms)", &frame_budget_ms, 1.0f, 50.0f);
+	if (ImGui::Button("Reset"))
+		ResetFrameTimes();
+	if (count == 0)
+		return;
+
+	// oldest first
+	float history[FRAME_TIME_HISTORY];
+	int oldest = frame_time_count - count;
+	for (int i = 0; i < count; i++)
+	{
+		history[i] = frame_times[(oldest + i) % FRAME_TIME_HISTORY];
+	}
+	float plot_max = SDL_max(stats.max_ms, frame_budget_ms) * 1.1f;
+	ImGui::PlotLines("##frame_times", history, count, 0, "Frame Time", 0.0f, plot_max, { 0.0f, 60.0f });
+
+	// buckets span 0 to plot_max, so the budget line sits at the same place in both plots
+	float buckets[FRAME_TIME_BUCKETS] = {};
+	for (int i = 0; i < count; i++)
+	{
+		int bucket = (int)(history[i] / plot_max * FRAME_TIME_BUCKETS);
+		buckets[SDL_clamp(bucket, 0, FRAME_TIME_BUCKETS - 1)] += 1.0f;
+	}
+	char overlay[64];
+	SDL_snprintf(overlay, sizeof(overlay), "0 - %.1f ms", plot_max);
+	ImGui::PlotHistogram("##frame_time_histogram", buckets, FRAME_TIME_BUCKETS, 0, overlay, 0.0f, FLT_MAX, { 0.0f, 60.0f });
+}
+/////////////////////////////////////////////////////////
+
+//////////////////// Benchmark //////////////////////////
+// --benchmark <path file> [--benchmark-out <file.json>]
+// drives the player along a camera path with a fixed dt, records per pass timings every frame
+// and reports frame time percentiles plus ray and pixel throughput as JSON.
+// path files hold one "time x y angle_degrees" keyframe per line, # starts a comment
+
+#define FIXED_DT (1.0f / 60.0f)
+#define MAX_CAMERA_KEYS 256
+#define MAX_BENCHMARK_FRAMES 36000
+
+struct CameraKey
+{
+	float time, x, y, angle; // angle in degrees, not wrapped so paths can spin
+};
+
+struct BenchmarkFrame
+{
+	float frame_ms, cast_ms, ray_cast_ms, raster_ms, upload_ms;
+	int rays, pixels;
+};
+
+struct FrameStats
+{
+	float avg, p50, p95, p99, max;
+};
+
+struct Benchmark
+{
+	bool enabled = false;
+	const char* path = nullptr;
+	const char* output = nullptr; // stdout when null
+	CameraKey keys[MAX_CAMERA_KEYS];
+	int key_count = 0;
+	float time = 0.0f;
+	BenchmarkFrame frames[MAX_BENCHMARK_FRAMES];
+	int frame_count = 0;
+	ProfilerZoneTotals cast_zones = {}, raster_zones = {}; // hardware counters over the whole run
+};
+
+Benchmark benchmark;
+
+bool LoadCameraPath(const char* path)
+{
+	size_t size = 0;
+	char* text = (char*)SDL_LoadFile(path, &size);
+	if (!text)
+		return false;
+
+	benchmark.key_count = 0;
+	for (char* line = text; line && *line; )
+	{
+		char* next = SDL_strchr(line, '\n');
+		if (next)
+			*next++ = '\0';
+
+		CameraKey key;
+		if (line[0] != '#' && benchmark.key_count < MAX_CAMERA_KEYS &&
+			SDL_sscanf(line, "%f %f %f %f", &key.time, &key.x, &key.y, &key.angle) == 4)
+		{
+			benchmark.keys[benchmark.key_count++] = key;
+		}
+		line = next;
+	}
+	SDL_free(text);
+
+	return benchmark.key_count > 0;
+}
+
+// places the player on the path, keys are linearly interpolated
+void ApplyCameraPath(float time)
+{
+	const CameraKey* keys = benchmark.keys;
+	int k = 0;
+	while (k + 1 < benchmark.key_count && keys[k + 1].time <= time)
+		k++;
+
+	CameraKey key = keys[k];
+	if (k + 1 < benchmark.key_count)
+	{
+		const CameraKey& next = keys[k + 1];
+		float t = SDL_clamp((time - key.time) / SDL_max(next.time - key.time, 1e-6f), 0.0f, 1.0f);
+		key.x += (next.x - key.x) * t;
+		key.y += (next.y - key.y) * t;
+		key.angle += (next.angle - key.angle) * t;
+	}
+
+	player.x = key.x;
+	player.y = key.y;
+	player.rotation_angle = key.angle * TORAD;
+	player.walk_direction = 0;
+	player.turn_direction = 0;
+}
+
+bool BenchmarkFinished()
+{
+	return benchmark.frame_count == MAX_BENCHMARK_FRAMES ||
+		benchmark.time > benchmark.keys[benchmark.key_count - 1].time;
+}
+
+void RecordBenchmarkFrame(float frame_ms)
+{
+	BenchmarkFrame& frame = benchmark.frames[benchmark.frame_count++];
+	frame.frame_ms = frame_ms;
+	frame.cast_ms = cast_ms;
+	frame.ray_cast_ms = ray_cast_ms;
+	frame.raster_ms = raster_ms;
+	frame.upload_ms = color_buffer_upload_ms;
+	frame.rays = num_rays;
+	frame.pixels = render_width * render_height;
+
+	ProfilerZoneTotals cast = SumLastFrameZones("Cast");
+	ProfilerZoneTotals raster = SumLastFrameZones("Raster");
+	ProfilerZoneTotals slices = SumLastFrameZones("Raster Slice");
+	for (int c = 0; c < HW_COUNTER_COUNT; c++)
+	{
+		benchmark.cast_zones.counters[c] += cast.counters[c];
+		benchmark.raster_zones.counters[c] += raster.counters[c] + slices.counters[c];
+	}
+}
+
+// sorts values in place, percentiles are nearest rank
+FrameStats ComputeFrameStats(float* values, int count)
+{
+	FrameStats stats = {};
+	if (count == 0)
+		return stats;
+
+	std::sort(values, values + count);
+
+	double sum = 0.0;
+	for (int i = 0; i < count; i++)
+	{
+		sum += values[i];
+	}
+
+	auto percentile = [&](float p) { return values[SDL_clamp((int)ceilf(p * count) - 1, 0, count - 1)]; };
+	stats.avg = (float)(sum / count);
+	stats.p50 = percentile(0.50f);
+	stats.p95 = percentile(0.95f);
+	stats.p99 = percentile(0.99f);
+	stats.max = values[count - 1];
+	return stats;
+}
+
+int AppendStatsJson(char* out, size_t size, const char* name, size_t member_offset, bool last)
+{
+	static float values[MAX_BENCHMARK_FRAMES];
+	for (int i = 0; i < benchmark.frame_count; i++)
+	{
+		values[i] = *(const float*)((const uint8_t*)&benchmark.frames[i] + member_offset);
+	}
+
+	FrameStats stats = ComputeFrameStats(values, benchmark.frame_count);
+	return SDL_snprintf(out, size,
+		"  \"%s\": { \"avg\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f }%s\n",
+		name, stats.avg, stats.p50, stats.p95, stats.p99, stats.max, last ? "" : ",");
+}
+
+int AppendCountersJson(char* out, size_t size, const char* name, const ProfilerZoneTotals& totals, const char* item, double items, bool last)
+{
+	const uint64_t* counters = totals.counters;
+	items = SDL_max(items, 1.0);
+	return SDL_snprintf(out, size,
+		"    \"%s\": { \"per\": \"%s\", \"ipc\": %.3f, \"cycles\": %.3f, \"instructions\": %.3f, "
+		"\"l1d_misses\": %.5f, \"llc_misses\": %.5f, \"branch_misses\": %.5f }%s\n",
+		name, item, counters[HW_CYCLES] ? (double)counters[HW_INSTRUCTIONS] / counters[HW_CYCLES] : 0.0,
+		counters[HW_CYCLES] / items, counters[HW_INSTRUCTIONS] / items,
+		counters[HW_L1D_MISSES] / items, counters[HW_LLC_MISSES] / items, counters[HW_BRANCH_MISSES] / items,
+		last ? "" : ",");
+}
+
+// copies text into out as the inside of a JSON string, windows paths are full of backslashes
+void EscapeJsonString(char* out, size_t size, const char* text)
+{
+	size_t length = 0;
+	for (; *text && length + 2 < size; text++)
+	{
+		if (*text == '\\' || *text == '"')
+			out[length++] = '\\';
+		out[length++] = *text;
+	}
+	out[length] = '\0';
+}
+
+void WriteBenchmarkReport()
+{
+	double rays_cast = 0.0, pixels = 0.0, ray_cast_s = 0.0, raster_s = 0.0, frame_s = 0.0;
+	for (int i = 0; i < benchmark.frame_count; i++)
+	{
+		const BenchmarkFrame& frame = benchmark.frames[i];
+		rays_cast += frame.rays;
+		pixels += frame.pixels;
+		ray_cast_s += frame.ray_cast_ms / 1000.0;
+		raster_s += frame.raster_ms / 1000.0;
+		frame_s += frame.frame_ms / 1000.0;
+	}
+
+	char path[512];
+	EscapeJsonString(path, sizeof(path), benchmark.path);
+
+	char report[4096];
+	int length = SDL_snprintf(report, sizeof(report),
+		"{\n"
+		"  \"path\": \"%s\",\n"
+		"  \"frames\": %d,\n"
+		"  \"dt\": %.6f,\n"
+		"  \"render_resolution\": [%d, %d],\n"
+		"  \"rays_per_sec\": %.0f,\n"
+		"  \"pixels_per_sec\": %.0f,\n"
+		"  \"frames_per_sec\": %.2f,\n",
+		path, benchmark.frame_count, FIXED_DT, render_width, render_height,
+		ray_cast_s > 0.0 ? rays_cast / ray_cast_s : 0.0,
+		raster_s > 0.0 ? pixels / raster_s : 0.0,
+		frame_s > 0.0 ? benchmark.frame_count / frame_s : 0.0);
+	length += AppendStatsJson(report + length, sizeof(report) - length, "frame_ms", offsetof(BenchmarkFrame, frame_ms), false);
+	length += AppendStatsJson(report + length, sizeof(report) - length, "cast_ms", offsetof(BenchmarkFrame, cast_ms), false);
+	length += AppendStatsJson(report + length, sizeof(report) - length, "ray_cast_ms", offsetof(BenchmarkFrame, ray_cast_ms), false);
+	length += AppendStatsJson(report + length, sizeof(report) - length, "raster_ms", offsetof(BenchmarkFrame, raster_ms), false);
+	length += AppendStatsJson(report + length, sizeof(report) - length, "upload_ms", offsetof(BenchmarkFrame, upload_ms), !hardware_counters_available);
+	if (hardware_counters_available)
+	{
+		length += SDL_snprintf(report + length, sizeof(report) - length, "  \"counters\": {\n");
+		length += AppendCountersJson(report + length, sizeof(report) - length, "cast", benchmark.cast_zones, "ray", rays_cast, false);
+		length += AppendCountersJson(report + length, sizeof(report) - length, "raster", benchmark.raster_zones, "pixel", pixels, true);
+		length += SDL_snprintf(report + length, sizeof(report) - length, "  }\n");
+	}
+	SDL_snprintf(report + length, sizeof(report) - length, "}\n");
+
+	if (!benchmark.output)
+	{
+		std::cout << report;
+		return;
+	}
+
+	if (!SDL_SaveFile(benchmark.output, report, SDL_strlen(report)))
+		std::cout << "Failed To Write " << benchmark.output << "\n";
+}
+/////////////////////////////////////////////////////////
+
+//////////////////// HitchCapture ///////////////////////
+// always on: the last HITCH_FRAMES frames of counters sit in a ring next to the profiler rings.
+// a frame over the threshold arms a dump, HITCH_FRAMES_AFTER frames later the window around it
+// is copied out on the main thread (no allocation, no file io) and a low priority thread writes
+// <prefix>_<frame>.trace.json and <prefix>_<frame>.state.json while the game keeps running.
+// finished F9 / --trace captures are written by the same thread
+
+#define HITCH_FRAMES 300
+#define HITCH_FRAMES_AFTER 30
+#define HITCH_WARMUP_FRAMES 30 // startup frames build textures and fonts, not worth a dump
+#define MAX_HITCH_EVENTS (PROFILER_RING_SIZE * 4)
+
+struct HitchFrame
+{
+	int frame;
+	float frame_ms, cast_ms, raster_ms, upload_ms;
+	int64_t pixels_written, bytes_touched;
+	int allocations;
+	float x, y, angle;
+};
+
+// what the game looked like when the dump was taken
+struct HitchState
+{
+	int hitch_frame;
+	float hitch_ms;
+	float x, y, angle;
+	int render_width, render_height, output_width, output_height;
+	float resolution_scale;
+	int sprite_count, visible_sprite_count;
+	bool pipelined, indexed, column_major;
+	Door doors[MAX_DOORS];
+	int door_count;
+};
+
+struct HitchCapture
+{
+	bool enabled = true;
+	bool forced = false; // --hitch-ms, keeps it on in headless and benchmark runs
+	float threshold_ms = 50.0f;
+	const char* prefix = "hitch";
+
+	HitchFrame frames[HITCH_FRAMES];
+	int frame_count = 0; // frames ever recorded
+	int frames_after = 0; // > 0 while a dump is armed
+	int hitch_frame = 0;
+	float hitch_ms = 0.0f;
+	int dumps = 0;
+	int skipped = 0; // hitches while the writer was still busy
+
+	// handed to the writer, untouched by the main thread while writing is set
+	TraceEvent* events = nullptr;
+	int event_count = 0;
+	uint64_t origin = 0;
+	HitchFrame dump_frames[HITCH_FRAMES];
+	int dump_frame_count = 0;
+	HitchState state;
+
+	SDL_AtomicInt writing;
+	SDL_AtomicInt trace_writing; // trace_capture belongs to the writer while set
+	char trace_path[512];
+	SDL_AtomicInt quit;
+	SDL_Semaphore* wake = nullptr;
+	SDL_Thread* thread = nullptr;
+};
+
+HitchCapture hitch;
+
+bool WriteHitchState(const char* path)
+{
+	SDL_IOStream* file = SDL_IOFromFile(path, "wb");
+	if (!file)
+		return false;
+
+	const HitchState& state = hitch.state;
+	SDL_IOprintf(file,
+		"{\n"
+		"  \"hitch_frame\": %d,\n"
+		"  \"hitch_ms\": %.3f,\n"
+		"  \"player\": { \"x\": %.3f, \"y\": %.3f, \"angle_degrees\": %.3f },\n"
+		"  \"render_resolution\": [%d, %d],\n"
+		"  \"output_resolution\": [%d, %d],\n"
+		"  \"resolution_scale\": %.3f,\n"
+		"  \"sprites\": %d,\n"
+		"  \"visible_sprites\": %d,\n"
+		"  \"pipelined\": %s,\n"
+		"  \"indexed\": %s,\n"
+		"  \"column_major\": %s,\n",
+		state.hitch_frame, state.hitch_ms, state.x, state.y, state.angle / TORAD,
+		state.render_width, state.render_height, state.output_width, state.output_height, state.resolution_scale,
+		state.sprite_count, state.visible_sprite_count,
+		state.pipelined ? "true" : "false", state.indexed ? "true" : "false", state.column_major ? "true" : "false");
+
+	SDL_IOprintf(file, "  \"doors\": [");
+	for (int i = 0; i < state.door_count; i++)
+	{
+		const Door& door = state.doors[i];
+		SDL_IOprintf(file, "%s\n    { \"row\": %d, \"col\": %d, \"state\": %d, \"open\": %.3f }",
+			i ? "," : "", door.row, door.col, (int)door.state, door.open);
+	}
+	SDL_IOprintf(file, "\n  ],\n  \"frames\": [");
+	for (int i = 0; i < hitch.dump_frame_count; i++)
+	{
+		const HitchFrame& frame = hitch.dump_frames[i];
+		SDL_IOprintf(file,
+			"%s\n    { \"frame\": %d, \"frame_ms\": %.3f, \"cast_ms\": %.3f, \"raster_ms\": %.3f, \"upload_ms\": %.3f, "
+			"\"pixels_written\": %lld, \"bytes_touched\": %lld, \"allocations\": %d, \"x\": %.2f, \"y\": %.2f, \"angle_degrees\": %.2f }",
+			i ? "," : "", frame.frame, frame.frame_ms, frame.cast_ms, frame.raster_ms, frame.upload_ms,
+			(long long)frame.pixels_written, (long long)frame.bytes_touched, frame.allocations, frame.x, frame.y, frame.angle / TORAD);
+	}
+	SDL_IOprintf(file, "\n  ]\n}\n");
+	return SDL_CloseIO(file);
+}
+
+void WriteHitchDump()
+{
+	char trace_path[512], state_path[512];
+	SDL_snprintf(trace_path, sizeof(trace_path), "%s_%05d.trace.json", hitch.prefix, hitch.state.hitch_frame);
+	SDL_snprintf(state_path, sizeof(state_path), "%s_%05d.state.json", hitch.prefix, hitch.state.hitch_frame);
+	bool written = WriteHitchState(state_path);
+	if (hitch.event_count > 0)
+		written &= WriteTraceEvents(trace_path, hitch.events, hitch.event_count, hitch.origin, 0);
+
+	if (written)
+		std::cout << "Hitch Captured: frame " << hitch.state.hitch_frame << " took " << hitch.state.hitch_ms << " ms, " << state_path << "\n";
+	else
+		std::cout << "Failed To Write " << state_path << "\n";
+}
+
+// one wake per queued job, pending work is finished before quitting
+int HitchWriterMain(void*)
+{
+	SDL_SetCurrentThreadPriority(SDL_THREAD_PRIORITY_LOW);
+	while (true)
+	{
+		SDL_WaitSemaphore(hitch.wake);
+
+		if (SDL_GetAtomicInt(&hitch.trace_writing))
+		{
+			if (WriteTraceCapture(hitch.trace_path))
+				std::cout << "Trace Written: " << hitch.trace_path << " (" << trace_capture.event_count << " events, " << trace_capture.dropped << " dropped)\n";
+			else
+				std::cout << "Failed To Write " << hitch.trace_path << "\n";
+			SDL_SetAtomicInt(&hitch.trace_writing, 0);
+		}
+
+		if (SDL_GetAtomicInt(&hitch.writing))
+		{
+			WriteHitchDump();
+			SDL_SetAtomicInt(&hitch.writing, 0);
+		}
+
+		if (SDL_GetAtomicInt(&hitch.quit))
+			break;
+	}
+	return 0;
+}
+
+void InitHitchCapture(bool offline_run)
+{
+	if (offline_run && !hitch.forced)
+		hitch.enabled = false;
+
+	hitch.events = (TraceEvent*)SDL_malloc(sizeof(TraceEvent) * MAX_HITCH_EVENTS);
+	hitch.wake = SDL_CreateSemaphore(0);
+	SDL_SetAtomicInt(&hitch.writing, 0);
+	SDL_SetAtomicInt(&hitch.trace_writing, 0);
+	SDL_SetAtomicInt(&hitch.quit, 0);
+	hitch.thread = SDL_CreateThread(HitchWriterMain, "hitch writer", nullptr);
+}
+
+// dumps and traces already handed over are written first
+void ShutdownHitchCapture()
+{
+	SDL_SetAtomicInt(&hitch.quit, 1);
+	SDL_SignalSemaphore(hitch.wake);
+	SDL_WaitThread(hitch.thread, nullptr);
+	SDL_DestroySemaphore(hitch.wake);
+	SDL_free(hitch.events);
+	hitch.events = nullptr;
+}
+
+void DumpHitch()
+{
+	int count = SDL_min(hitch.frame_count, HITCH_FRAMES);
+	int oldest = hitch.frame_count - count;
+	for (int i = 0; i < count; i++)
+	{
+		hitch.dump_frames[i] = hitch.frames[(oldest + i) % HITCH_FRAMES];
+	}
+	hitch.dump_frame_count = count;
+
+	// the profiler keeps as many frames as we do, start at its oldest
+	hitch.origin = ProfilerHistoryStart();
+	hitch.event_count = CollectRecentTraceEvents(hitch.origin, hitch.events, MAX_HITCH_EVENTS);
+
+	HitchState& state = hitch.state;
+	state.hitch_frame = hitch.hitch_frame;
+	state.hitch_ms = hitch.hitch_ms;
+	state.x = player.x;
+	state.y = player.y;
+	state.angle = player.rotation_angle;
+	state.render_width = render_width;
+	state.render_height = render_height;
+	state.output_width = output_width;
+	state.output_height = output_height;
+	state.resolution_scale = resolution_governor.scale;
+	state.sprite_count = sprites.count;
+	state.visible_sprite_count = visible_sprite_count;
+	state.pipelined = pipelined_frames;
+	state.indexed = indexed_color_buffer;
+	state.column_major = color_buffer_layout == ColorBufferLayout::COLUMN_MAJOR;
+	state.door_count = door_count;
+	SDL_memcpy(state.doors, doors, sizeof(Door) * door_count);
+
+	hitch.dumps++;
+	SDL_SetAtomicInt(&hitch.writing, 1);
+	SDL_SignalSemaphore(hitch.wake);
+}
+
+// call once at the end of every frame, after the profiler and allocation frames ended
+void RecordHitchFrame(int frame_index, float frame_ms)
+{
+	HitchFrame& frame = hitch.frames[hitch.frame_count % HITCH_FRAMES];
+	frame.frame = frame_index;
+	frame.frame_ms = frame_ms;
+	frame.cast_ms = cast_ms;
+	frame.raster_ms = raster_ms;
+	frame.upload_ms = color_buffer_upload_ms;
+	frame.pixels_written = 0;
+	frame.bytes_touched = 0;
+	for (int p = 0; p < PASS_COUNT; p++)
+	{
+		frame.pixels_written += pass_counters[p].pixels;
+		frame.bytes_touched += pass_counters[p].bytes;
+	}
+	frame.allocations = 0;
+	for (int s = 0; s < ALLOC_SUBSYSTEM_COUNT; s++)
+	{
+		frame.allocations += allocations.last_frame[s].count;
+	}
+	frame.x = player.x;
+	frame.y = player.y;
+	frame.angle = player.rotation_angle;
+	hitch.frame_count++;
+
+	if (hitch.frames_after > 0)
+	{
+		if (--hitch.frames_after == 0)
+			DumpHitch();
+		return;
+	}
+
+	if (!hitch.enabled || frame_ms <= hitch.threshold_ms || hitch.frame_count <= HITCH_WARMUP_FRAMES || ProfilerPaused())
+		return;
+
+	if (SDL_GetAtomicInt(&hitch.writing))
+	{
+		hitch.skipped++;
+		return;
+	}
+
+	hitch.hitch_frame = frame_index;
+	hitch.hitch_ms = frame_ms;
+	hitch.frames_after = HITCH_FRAMES_AFTER;
+}
+/////////////////////////////////////////////////////////
+
+//////////////////// Telemetry //////////////////////////
+// --telemetry <file> keeps the last TELEMETRY_RECORDS frames in a memory mapped ring, see telemetry.h.
+// off by default, the file is opened before the first frame and only stored into after that
+
+TelemetryFile telemetry;
+
+void InitTelemetry(const char* path)
+{
+	if (!path)
+		return;
+
+	if (OpenTelemetryFile(telemetry, path, TELEMETRY_RECORDS))
+		std::cout << "Telemetry: " << path << ", " << TELEMETRY_RECORDS << " frames\n";
+	else
+		std::cout << "Failed To Open " << path << "\n";
+}
+
+// call right after RecordHitchFrame, the frame's counters are taken from the hitch ring
+void RecordTelemetryFrame(int frame_index, uint64_t frame_start)
+{
+	if (!telemetry.header)
+		return;
+
+	const HitchFrame& frame = hitch.frames[(hitch.frame_count - 1) % HITCH_FRAMES];
+	TelemetryRecord& record = BeginTelemetryRecord(telemetry);
+	record.timestamp = frame_start;
+	record.frame = frame_index;
+	record.frame_ms = frame.frame_ms;
+	record.cast_ms = frame.cast_ms;
+	record.raster_ms = frame.raster_ms;
+	record.upload_ms = frame.upload_ms;
+	record.x = frame.x;
+	record.y = frame.y;
+	record.angle = frame.angle;
+	record.render_width = render_width;
+	record.render_height = render_height;
+	record.resolution_scale = resolution_governor.scale;
+	record.allocations = frame.allocations;
+	record.live_bytes = 0;
+	for (int s = 0; s < ALLOC_SUBSYSTEM_COUNT; s++)
+	{
+		record.live_bytes += SDL_GetAtomicInt(&allocations.live_bytes[s]);
+	}
+	record.pixels_written = frame.pixels_written;
+	record.bytes_touched = frame.bytes_touched;
+	record.visible_sprites = visible_sprite_count;
+	record.hitch_dumps = hitch.dumps;
+	EndTelemetryRecord(telemetry, record);
+}
+/////////////////////////////////////////////////////////
+
+//////////////////// Headless ///////////////////////////
+// --headless [--frames N] [--dump-ppm prefix] [--dump-every N], with --benchmark the path decides the frame count
+// no window and no ImGui, the software renderer draws into an offscreen surface on the
+// dummy video driver and dt is fixed, so perf numbers reproduce on a CI box without a GPU
+
+struct HeadlessOptions
+{
+	bool enabled = false;
+	int frames = 600;
+	const char* dump_prefix = nullptr; // frames go to <prefix>00042.ppm
+	int dump_every = 1;
+};
+
+HeadlessOptions headless;
+
+// F9 or --trace <frames> captures that many frames into a Chrome trace
+int trace_frames = 120;
+bool trace_on_start = false;
+const char* trace_output = nullptr; // defaults to trace_<frame>.json
+const char* telemetry_output = nullptr;
+
+void ParseCommandLine(int argc, char** argv)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		if (!SDL_strcmp(argv[i], "--headless"))
+			headless.enabled = true;
+		else if (!SDL_strcmp(argv[i], "--frames") && i + 1 < argc)
+			headless.frames = SDL_max(SDL_atoi(argv[++i]), 1);
+		else if (!SDL_strcmp(argv[i], "--dump-ppm") && i + 1 < argc)
+			headless.dump_prefix = argv[++i];
+		else if (!SDL_strcmp(argv[i], "--dump-every") && i + 1 < argc)
+			headless.dump_every = SDL_max(SDL_atoi(argv[++i]), 1);
+		else if (!SDL_strcmp(argv[i], "--benchmark") && i + 1 < argc)
+		{
+			benchmark.enabled = true;
+			benchmark.path = argv[++i];
+		}
+		else if (!SDL_strcmp(argv[i], "--benchmark-out") && i + 1 < argc)
+			benchmark.output = argv[++i];
+		else if (!SDL_strcmp(argv[i], "--trace") && i + 1 < argc)
+		{
+			trace_on_start = true;
+			trace_frames = SDL_max(SDL_atoi(argv[++i]), 1);
+		}
+		else if (!SDL_strcmp(argv[i], "--trace-out") && i + 1 < argc)
+			trace_output = argv[++i];
+		else if (!SDL_strcmp(argv[i], "--hitch-ms") && i + 1 < argc)
+		{
+			hitch.forced = true;
+			hitch.threshold_ms = (float)SDL_atof(argv[++i]);
+		}
+		else if (!SDL_strcmp(argv[i], "--hitch-out") && i + 1 < argc)
+			hitch.prefix = argv[++i];
+		else if (!SDL_strcmp(argv[i], "--telemetry") && i + 1 < argc)
+			telemetry_output = argv[++i];
+		else
+			std::cout << "Unknown Argument: " << argv[i] << "\n";
+	}
+}
+
+bool WritePPM(const char* path, SDL_Surface* surface)
+{
+	SDL_Surface* rgb = SDL_ConvertSurface(surface, SDL_PIXELFORMAT_RGB24);
+	if (!rgb)
+		return false;
+
+	SDL_IOStream* file = SDL_IOFromFile(path, "wb");
+	if (file)
+	{
+		SDL_IOprintf(file, "P6\n%d %d\n255\n", rgb->w, rgb->h);
+		for (int y = 0; y < rgb->h; y++)
+		{
+			SDL_WriteIO(file, (const uint8_t*)rgb->pixels + (rgb->pitch * y), (size_t)rgb->w * 3);
+		}
+		SDL_CloseIO(file);
+	}
+	SDL_DestroySurface(rgb);
+	return file != nullptr;
+}
+
+// reads back what has been drawn so far this frame, call before SDL_RenderPresent
+void DumpFrame(SDL_Renderer* renderer, int frame)
+{
+	SDL_Surface* surface = SDL_RenderReadPixels(renderer, nullptr);
+	if (!surface)
+		return;
+
+	char path[512];
+	SDL_snprintf(path, sizeof(path), "%s%05d.ppm", headless.dump_prefix, frame);
+	if (!WritePPM(path, surface))
+		std::cout << "Failed To Write " << path << "\n";
+	SDL_DestroySurface(surface);
+}
+
+// hands the events to the hitch writer thread, writing a long capture here would itself be a hitch
+void FinishTraceCapture(int frame)
+{
+	if (trace_output)
+		SDL_strlcpy(hitch.trace_path, trace_output, sizeof(hitch.trace_path));
+	else
+		SDL_snprintf(hitch.trace_path, sizeof(hitch.trace_path), "trace_%05d.json", frame);
+
+	trace_capture.active = false;
+	trace_capture.complete = false;
+	SDL_SetAtomicInt(&hitch.trace_writing, 1);
+	SDL_SignalSemaphore(hitch.wake);
+}
+
+// a new capture would reuse the events the writer may still be reading
+bool TraceCaptureBusy()
+{
+	return trace_capture.active || SDL_GetAtomicInt(&hitch.trace_writing);
+}
+/////////////////////////////////////////////////////////
+
+//////////////////// ProfilerView ///////////////////////
+// the last PROFILER_FRAME_HISTORY frames as a strip of bars, click one to pause and inspect it.
+// below, the selected frame as a flame graph, one lane per thread and one row per nesting depth
+
+int profiler_selected_frame = 0; // frames back from the newest
+
+#if PROFILER_ENABLED
+ImU32 ProfilerZoneColor(const char* name)
+{
+	uint32_t hash = 2166136261u;
+	for (const char* c = name; *c; c++)
+	{
+		hash = (hash ^ (uint8_t)*c) * 16777619u;
+	}
+	return ImColor::HSV((hash % 360) / 360.0f, 0.45f, 0.75f);
+}
+
+// zones of one thread overlapping [frame.start, frame.end), drawn at origin with the given width
+float DrawProfilerLane(const ProfilerThread& thread, const ProfilerFrame& frame, ImVec2 origin, float width)
+{
+	const float row_height = ImGui::GetTextLineHeight() + 2.0f;
+	const double frame_ticks = (double)SDL_max(frame.end - frame.start, (uint64_t)1);
+	const double tick_ms = 1000.0 / (double)SDL_GetPerformanceFrequency();
+	ImDrawList* draw_list = ImGui::GetWindowDrawList();
+	ImVec2 mouse = ImGui::GetMousePos();
+
+	uint32_t count = (uint32_t)SDL_GetAtomicInt((SDL_AtomicInt*)&thread.zone_count);
+	uint32_t oldest = count > PROFILER_RING_SIZE ? count - PROFILER_RING_SIZE : 0;
+	int max_depth = -1;
+
+	for (uint32_t i = count; i > oldest; i--)
+	{
+		const ProfilerZone& zone = thread.zones[(i - 1) % PROFILER_RING_SIZE];
+		if (zone.end <= frame.start)
+			break; // ordered by end time, everything older ends before the frame
+		if (zone.start >= frame.end)
+			continue;
+
+		uint64_t start = SDL_max(zone.start, frame.start);
+		uint64_t end = SDL_min(zone.end, frame.end);
+		ImVec2 min = { origin.x + (float)((start - frame.start) / frame_ticks) * width, origin.y + zone.depth * row_height };
+		ImVec2 max = { origin.x + (float)((end - frame.start) / frame_ticks) * width, min.y + row_height - 1.0f };
+		max.x = SDL_max(max.x, min.x + 1.0f);
+
+		draw_list->AddRectFilled(min, max, ProfilerZoneColor(zone.name));
+		if (max.x - min.x > ImGui::CalcTextSize(zone.name).x + 4.0f)
+			draw_list->AddText({ min.x + 2.0f, min.y }, IM_COL32_BLACK, zone.name);
+
+		if (mouse.x >= min.x && mouse.x < max.x && mouse.y >= min.y && mouse.y < max.y)
+		{
+#if PROFILER_PERF_COUNTERS
+			ImGui::SetTooltip("%s\n%.3f ms\nIPC %.2f\nL1D misses %llu\nLLC misses %llu", zone.name, (zone.end - zone.start) * tick_ms,
+				zone.counters[HW_CYCLES] ? (double)zone.counters[HW_INSTRUCTIONS] / zone.counters[HW_CYCLES] : 0.0,
+				(unsigned long long)zone.counters[HW_L1D_MISSES], (unsigned long long)zone.counters[HW_LLC_MISSES]);
+#else
+			ImGui::SetTooltip("%s\n%.3f ms", zone.name, (zone.end - zone.start) * tick_ms);
+#endif
+		}
+
+		max_depth = SDL_max(max_depth, zone.depth);
+	}
+
+	return (max_depth + 1) * row_height;
+}
+#endif
+
+#if PROFILER_PERF_COUNTERS
+// per pass counters of one frame, normalised by the rays or pixels the pass worked on
+void DrawHardwareCounters(const ProfilerFrame& frame)
+{
+	ImGui::SeparatorText("Hardware Counters");
+	if (!hardware_counters_available)
+	{
+		ImGui::TextUnformatted("perf_event_open failed, check /proc/sys/kernel/perf_event_paranoid");
+		return;
+	}
+
+	struct Pass { const char* name; const char* item; double items; };
+	const double pixels = (double)render_width * render_height;
+	const Pass passes[] = {
+		{ "Cast", "ray", (double)num_rays },
+		{ "Sprites", "frame", 1.0 },
+		{ "Raster", "pixel", pixels },
+		{ "Raster Slice", "pixel", pixels },
+		{ "Upload", "pixel", pixels },
+		{ "Present", "frame", 1.0 },
+	};
+
+	if (!ImGui::BeginTable("##counters", 7, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+		return;
+	ImGui::TableSetupColumn("Pass");
+	ImGui::TableSetupColumn("Per");
+	ImGui::TableSetupColumn("IPC");
+	ImGui::TableSetupColumn("Cycles");
+	ImGui::TableSetupColumn("L1D Misses");
+	ImGui::TableSetupColumn("LLC Misses");
+	ImGui::TableSetupColumn("Branch Misses");
+	ImGui::TableHeadersRow();
+	for (const Pass& pass : passes)
+	{
+		ProfilerZoneTotals totals = SumProfilerZones(frame, pass.name);
+		if (totals.calls == 0)
+			continue;
+
+		const uint64_t* counters = totals.counters;
+		double items = SDL_max(pass.items, 1.0);
+		ImGui::TableNextRow();
+		ImGui::TableNextColumn(); ImGui::TextUnformatted(pass.name);
+		ImGui::TableNextColumn(); ImGui::TextUnformatted(pass.item);
+		ImGui::TableNextColumn(); ImGui::Text("%.2f", counters[HW_CYCLES] ? (double)counters[HW_INSTRUCTIONS] / counters[HW_CYCLES] : 0.0);
+		ImGui::TableNextColumn(); ImGui::Text("%.2f", counters[HW_CYCLES] / items);
+		ImGui::TableNextColumn(); ImGui::Text("%.4f", counters[HW_L1D_MISSES] / items);
+		ImGui::TableNextColumn(); ImGui::Text("%.4f", counters[HW_LLC_MISSES] / items);
+		ImGui::TableNextColumn(); ImGui::Text("%.4f", counters[HW_BRANCH_MISSES] / items);
+	}
+	ImGui::EndTable();
+}
+#endif
+
+void DrawProfilerWindow()
+{
+#if PROFILER_ENABLED
+	PROFILE_SCOPE("Profiler Window");
+	ImGui::Begin("Profiler");
+
+	// a paused profiler ends no frames, so a capture would never finish
+	ImGui::BeginDisabled(trace_capture.active);
+	bool paused = ProfilerPaused();
+	if (ImGui::Checkbox("Pause", &paused))
+		SDL_SetAtomicInt(&profiler.paused, paused);
+	ImGui::EndDisabled();
+
+	ImGui::SameLine();
+	ImGui::BeginDisabled(TraceCaptureBusy());
+	if (ImGui::Button("Capture Trace (F9)"))
+		StartTraceCapture(trace_frames);
+	ImGui::EndDisabled();
+	ImGui::SameLine();
+	ImGui::SetNextItemWidth(120.0f);
+	ImGui::SliderInt("Trace Frames", &trace_frames, 1, 1000);
+	if (trace_capture.active)
+		ImGui::Text("Capturing... %d events", trace_capture.event_count);
+	else if (TraceCaptureBusy())
+		ImGui::Text("Writing %s...", hitch.trace_path);
+
+	int available = SDL_min(profiler.frame_count, PROFILER_FRAME_HISTORY);
+	if (available == 0)
+	{
+		ImGui::End();
+		return;
+	}
+
+	ImGui::SameLine();
+	profiler_selected_frame = SDL_clamp(profiler_selected_frame, 0, available - 1);
+	ImGui::SliderInt("Frames Back", &profiler_selected_frame, 0, available - 1);
+
+	const double tick_ms = 1000.0 / (double)SDL_GetPerformanceFrequency();
+	auto history_frame = [&](int back) -> const ProfilerFrame&
+	{
+		return profiler.frames[(profiler.frame_count - 1 - back) % PROFILER_FRAME_HISTORY];
+	};
+
+	// frame strip, oldest on the left
+	float max_ms = 1.0f;
+	for (int back = 0; back < available; back++)
+	{
+		const ProfilerFrame& frame = history_frame(back);
+		max_ms = SDL_max(max_ms, (float)((frame.end - frame.start) * tick_ms));
+	}
+
+	ImVec2 origin = ImGui::GetCursorScreenPos();
+	float width = ImGui::GetContentRegionAvail().x;
+	float height = 60.0f;
+	float bar_width = width / PROFILER_FRAME_HISTORY;
+	ImGui::InvisibleButton("##frames", { width, height });
+	if (ImGui::IsItemClicked())
+	{
+		int slot = (int)((ImGui::GetMousePos().x - origin.x) / bar_width);
+		profiler_selected_frame = SDL_clamp(PROFILER_FRAME_HISTORY - 1 - slot, 0, available - 1);
+		if (!trace_capture.active)
+			SDL_SetAtomicInt(&profiler.paused, 1);
+	}
+
+	ImDrawList* draw_list = ImGui::GetWindowDrawList();
+	for (int back = 0; back < available; back++)
+	{
+		const ProfilerFrame& frame = history_frame(back);
+		float ms = (float)((frame.end - frame.start) * tick_ms);
+		float x = origin.x + (PROFILER_FRAME_HISTORY - 1 - back) * bar_width;
+		ImU32 color = back == profiler_selected_frame ? IM_COL32(255, 200, 60, 255) : IM_COL32(90, 140, 200, 255);
+		draw_list->AddRectFilled({ x, origin.y + height * (1.0f - ms / max_ms) }, { x + SDL_max(bar_width - 1.0f, 1.0f), origin.y + height }, color);
+	}
+
+	// flame graph of the selected frame
+	const ProfilerFrame& frame = history_frame(profiler_selected_frame);
+	ImGui::Text("Frame: %.3f ms (max in history %.3f ms)", (frame.end - frame.start) * tick_ms, max_ms);
+
+	for (int t = 0; t < ProfilerThreadCount(); t++)
+	{
+		const ProfilerThread& thread = profiler.threads[t];
+		ImGui::TextUnformatted(thread.name);
+		float lane_height = DrawProfilerLane(thread, frame, ImGui::GetCursorScreenPos(), ImGui::GetContentRegionAvail().x);
+		ImGui::Dummy({ ImGui::GetContentRegionAvail().x, SDL_max(lane_height, 1.0f) });
+	}
+
+#if PROFILER_PERF_COUNTERS
+	DrawHardwareCounters(frame);
+#endif
+
+	ImGui::End();
+#endif
+}
+/////////////////////////////////////////////////////////
+
+void DrawPerformanceDebugWindow()
+{
+	PROFILE_SCOPE("Debug Window");
+	ImGui::Begin("Performance Debug");
+	DrawFrameTimes();
+
+	ImGui::SeparatorText("Color Buffer");
+	ImGui::Text("Upload: %.3f ms", color_buffer_upload_ms);
+	ImGui::Text("Row Major: %.3f ms  Column Major: %.3f ms",
+		color_buffer_layout_frame_ms[0], color_buffer_layout_frame_ms[1]);
+	int layout = (int)color_buffer_layout;
+	if (ImGui::Combo("Layout", &layout, "Row Major\0Column Major\0"))
+	{
+		color_buffer_layout = (ColorBufferLayout)layout;
+		color_buffer_layout_auto = false;
+	}
+	if (ImGui::Checkbox("Auto Select", &color_buffer_layout_auto) && color_buffer_layout_auto)
+	{
+		layout_settle_frames = 0; // picked at the start of the next frame
+	}
+	ImGui::Checkbox("Pipelined Frames", &pipelined_frames);
+
+	ImGui::SeparatorText("Resolution");
+	ImGui::Checkbox("Dynamic Resolution", &resolution_governor.enabled);
+	ImGui::Checkbox("Integer Upscaling", &integer_upscaling);
+	ImGui::SliderFloat("Budget (ms)", &resolution_governor.budget_ms, 1.0f, 33.3f);
+	ImGui::Text("Scale: %.3f (%d x %d)", resolution_governor.scale, render_width, render_height);
+	ImGui::Text("Cast: %.3f ms  Raster: %.3f ms", cast_ms, raster_ms);
+	ImGui::Text("Headroom: %.3f ms", resolution_governor.budget_ms - resolution_governor.cost_ms);
+	ImGui::Text("Output: %d x %d", output_width, output_height);
+	if (ImGui::Checkbox("Fixed Internal Resolution", &fixed_internal_resolution))
+	{
+		render_targets_dirty = true;
+	}
+
+	ImGui::SeparatorText("Fog");
+	bool fog_changed = ImGui::SliderFloat("Fog Start", &fog_start_distance, 0.0f, 2048.0f);
+	fog_changed |= ImGui::SliderFloat("View Distance", &max_view_distance, 64.0f, 2048.0f);
+	if (fog_changed)
+	{
+		BuildColormap();
+		RemapSpriteTextures();
+	}
+
+	ImGui::SeparatorText("Sprites");
+	ImGui::Text("Visible: %d of %d  Project + Sort: %.3f ms", visible_sprite_count, sprites.count, sprite_project_ms);
+	ImGui::Text("Shapes: %d posts, %d texels (%.1f KB, %.1f KB unpacked)", sprite_post_count, sprite_texel_count,
+		(sprite_post_count * sizeof(SpritePost) + sprite_texel_count * 5) / 1024.0f,
+		(SPRITE_TEXTURE_COUNT * SPRITE_TEXTURE_SIZE * SPRITE_TEXTURE_SIZE * 5) / 1024.0f);
+	ImGui::SliderInt("Sprite Count", &benchmark_sprite_count, 0, MAX_SPRITES);
+	if (ImGui::Button("Spawn Benchmark Scene"))
+	{
+		SpawnBenchmarkSprites(benchmark_sprite_count, 1234);
+	}
+	ImGui::SameLine();
+	if (ImGui::Button("Level Sprites"))
+	{
+		SpawnLevelSprites();
+	}
+
+	ImGui::SeparatorText("Minimap");
+	int fan_mode = (int)ray_fan_mode;
+	if (ImGui::Combo("Ray Fan", &fan_mode, "Visibility Polygon\0Lines\0Off\0"))
+	{
+		ray_fan_mode = (RayFanMode)fan_mode;
+	}
+	if (ray_fan_mode == RayFanMode::LINES)
+		ImGui::SliderInt("Every Nth Ray", &ray_fan_line_stride, 1, 64);
+
+	ImGui::SeparatorText("Ray Stats");
+	ImGui::Checkbox("Record Ray Stats", &ray_stats_enabled);
+	if (ray_stats_enabled)
+	{
+		int heatmap = (int)ray_heatmap;
+		if (ImGui::Combo("Heatmap", &heatmap, "Off\0Cells Visited\0Intersection Tests\0Early Exit\0"))
+			ray_heatmap = (RayHeatmap)heatmap;
+		ImGui::Checkbox("On 3D View", &ray_heatmap_on_view);
+		ImGui::SameLine();
+		ImGui::Checkbox("On Ray Fan", &ray_heatmap_on_fan);
+		const RayFrameTotals& totals = ray_frame_totals;
+		ImGui::Text("Rays Cast: %d  Early Exits: %d", totals.rays, totals.early_exits);
+		ImGui::Text("Cells Visited: %d (max %d per ray)", totals.cells_visited, totals.max_cells_visited);
+		ImGui::Text("Intersection Tests: %d (max %d per ray)", totals.intersection_tests, totals.max_intersection_tests);
+		ImGui::Text("Wall Pixels Written: %lld", (long long)totals.pixels);
+		ImGui::TextDisabled("click a column of the 3D view to inspect its ray");
+	}
+
+	ImGui::SeparatorText("Hitch Capture");
+	ImGui::Checkbox("Capture Hitches", &hitch.enabled);
+	ImGui::SliderFloat("Hitch Threshold (ms)", &hitch.threshold_ms, 5.0f, 250.0f);
+	ImGui::Text("Dumps: %d  Skipped: %d%s", hitch.dumps, hitch.skipped,
+		SDL_GetAtomicInt(&hitch.writing) ? "  (writing)" : (hitch.frames_after > 0 ? "  (armed)" : ""));
+	if (hitch.dumps > 0)
+		ImGui::Text("Last: frame %d, %.2f ms", hitch.hitch_frame, hitch.hitch_ms);
+
+	ImGui::SeparatorText("Bandwidth");
+	ImGui::Checkbox("Overdraw View", &overdraw_view);
+	if (overdraw_view)
+	{
+		ImGui::SameLine();
+		ImGui::TextDisabled("blue 1, green 2, yellow 3, orange 4, red 5, white 6+ writes");
+	}
+	if (ImGui::BeginTable("##passes", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+	{
+		ImGui::TableSetupColumn("Pass");
+		ImGui::TableSetupColumn("Pixels");
+		ImGui::TableSetupColumn("MB");
+		ImGui::TableSetupColumn("Per Screen Pixel");
+		ImGui::TableHeadersRow();
+		double screen_pixels = SDL_max((double)render_width * render_height, 1.0);
+		int64_t raster_pixels = 0, total_bytes = 0;
+		for (int p = 0; p < PASS_COUNT; p++)
+		{
+			const PassCounter& counter = pass_counters[p];
+			if (p != PASS_UPLOAD)
+				raster_pixels += counter.pixels;
+			total_bytes += counter.bytes;
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn(); ImGui::TextUnformatted(raster_pass_names[p]);
+			ImGui::TableNextColumn(); ImGui::Text("%lld", (long long)counter.pixels);
+			ImGui::TableNextColumn(); ImGui::Text("%.2f", counter.bytes / (1024.0 * 1024.0));
+			ImGui::TableNextColumn(); ImGui::Text("%.2f", counter.pixels / screen_pixels);
+		}
+		ImGui::EndTable();
+		ImGui::Text("Overdraw: %.2fx  Bytes Touched: %.2f MB", raster_pixels / screen_pixels, total_bytes / (1024.0 * 1024.0));
+	}
+
+	ImGui::SeparatorText("Palette");
+	ImGui::Checkbox("8-bit Indexed", &indexed_color_buffer);
+	ImGui::Text("Palette Colors: %d", palette_size);
+	ImGui::SliderFloat("Fade", &palette_fade, 0.0f, 1.0f);
+	ImGui::SliderFloat("Damage Flash", &palette_flash, 0.0f, 1.0f);
+
+	ImGui::SeparatorText("Memory");
+#if ALLOCATION_TRACKING
+	ImGui::Checkbox("Assert On Hot Allocation", &allocations.enforce);
+	ImGui::Text("Hot Scope Allocations: %d", SDL_GetAtomicInt(&allocations.violations));
+	if (ImGui::BeginTable("##allocations", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+	{
+		ImGui::TableSetupColumn("Subsystem");
+		ImGui::TableSetupColumn("Allocs/Frame");
+		ImGui::TableSetupColumn("KB/Frame");
+		ImGui::TableSetupColumn("Live KB");
+		ImGui::TableSetupColumn("Budget KB");
+		ImGui::TableSetupColumn("Times Over");
+		ImGui::TableHeadersRow();
+		for (int s = 0; s < ALLOC_SUBSYSTEM_COUNT; s++)
+		{
+			const AllocFrameStats& frame = allocations.last_frame[s];
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn(); ImGui::TextUnformatted(alloc_subsystem_names[s]);
+			ImGui::TableNextColumn(); ImGui::Text("%d", frame.count);
+			ImGui::TableNextColumn(); ImGui::Text("%.1f", frame.bytes / 1024.0f);
+			ImGui::TableNextColumn();
+			if (allocations.over_budget[s])
+				ImGui::TextColored({ 1.0f, 0.3f, 0.3f, 1.0f }, "%.1f", SDL_GetAtomicInt(&allocations.live_bytes[s]) / 1024.0f);
+			else
+				ImGui::Text("%.1f", SDL_GetAtomicInt(&allocations.live_bytes[s]) / 1024.0f);
+			ImGui::TableNextColumn(); ImGui::Text("%d", allocations.budget_bytes[s] / 1024);
+			ImGui::TableNextColumn(); ImGui::Text("%d", allocations.budget_exceeded[s]);
+		}
+		ImGui::EndTable();
+	}
+#else
+	ImGui::TextUnformatted("Built with ALLOCATION_TRACKING 0");
+#endif
+	ImGui::End();
+}
+
+
+int main(int argc, char** argv)
+{
+	InstallAllocationHooks();
+	ParseCommandLine(argc, argv);
+	ProfilerRegisterThread("Main"); // before the raster workers start, so main is thread 0
+	if (headless.enabled)
+		SDL_SetHint(SDL_HINT_VIDEO_DRIVER, "dummy");
+
+	// init sdl3
+	if (!SDL_Init(SDL_INIT_VIDEO))
+	{
+		std::cout << "Failed To Init SDL3!\n";
+		return 1;
+	}
+
+	if (benchmark.enabled && !LoadCameraPath(benchmark.path))
+	{
+		std::cout << "Failed To Load Camera Path " << benchmark.path << "\n";
+		return 1;
+	}
+
+	SDL_Window* window = nullptr;
+	SDL_Surface* headless_surface = nullptr;
+	SDL_Renderer* renderer = nullptr;
+
+	if (headless.enabled)
+	{
+		// no window, the software renderer draws straight into a surface
+		fixed_internal_resolution = true;
+		headless_surface = SDL_CreateSurface(WINDOW_WIDTH, WINDOW_HEIGHT, SDL_PIXELFORMAT_ARGB8888);
+		if (headless_surface)
+			renderer = SDL_CreateSoftwareRenderer(headless_surface);
+	}
+	else
+	{
+		// create sdl window
+		auto window_falgs =
+			SDL_WINDOW_RESIZABLE |
+			SDL_WINDOW_HIGH_PIXEL_DENSITY |
+			SDL_WINDOW_INPUT_FOCUS;
+
+		window = SDL_CreateWindow("wolf 3d", WINDOW_WIDTH, WINDOW_HEIGHT, window_falgs);
+
+		if (!window)
+		{
+			std::cout << "Failed To Create SDL3 Widnow!\n";
+			return 1;
+		}
+
+		// create renderer
+		renderer = SDL_CreateRenderer(window, NULL);
+	}
+
+	if (!renderer)
+	{
+		std::cout << "Failed To Create SDL3 renderer!\n";
+		return 1;
+	}
+
+	// alpha blending
+	SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+
+
+	// color buffer
+	BuildColormap();
+	BuildSpriteTextures();
+	RemapSpriteTextures();
+	SpawnLevelSprites();
+	InitDoors();
+	CreateMinimapTexture(renderer);
+	ApplyWindowSize(window, renderer);
+	layout_settle_frames = 0; // nothing to stall yet, pick the starting layout right away
+	SelectColorBufferLayout();
+	InitRasterWorkers();
+	InitHitchCapture(headless.enabled || benchmark.enabled);
+	InitTelemetry(telemetry_output);
+
+	if (!headless.enabled)
+	{
+		// Setup Dear ImGui context
+		IMGUI_CHECKVERSION();
+		ImGui::SetAllocatorFunctions(ImGuiTrackedAlloc, ImGuiTrackedFree);
+		ImGui::CreateContext();
+		ImGuiIO& io = ImGui::GetIO(); (void)io;
+
+		// Setup Dear ImGui style
+		ImGui::StyleColorsDark();
+
+		// Setup Platform/Renderer bindings
+		ImGui_ImplSDL3_InitForSDLRenderer(window, renderer);
+		ImGui_ImplSDLRenderer3_Init(renderer);
+	}
+	else if (!benchmark.enabled)
+	{
+		// no input, spin in place so every frame sees a different view
+		player.turn_direction = 1;
+	}
+
+	// game loop
+
+	SDL_Event event;
+	bool is_window_running = true;
+	int frame_index = 0;
+	double headless_frame_ms = 0.0;
+	double headless_cast_ms = 0.0;
+	double headless_raster_ms = 0.0;
+	if (trace_on_start)
+		StartTraceCapture(trace_frames);
+	while (is_window_running)
+	{
+		uint64_t frame_start = SDL_GetPerformanceCounter();
+		ProfilerBeginFrame();
+
+		// at most one frame in flight, the previous raster must finish before we touch player or rays
+		WaitRasterJob();
+		if (!pipelined_frames)
+			pipelined_frame_ready = false;
+
+		SetRenderResolution(resolution_governor.Update(cast_ms + raster_ms));
+
+		if (render_targets_dirty)
+		{
+			ApplyWindowSize(window, renderer);
+			render_targets_dirty = false;
+		}
+		SelectColorBufferLayout();
+
+		uint64_t currentTime = SDL_GetPerformanceCounter();
+		float frame_seconds = (float)((double)(currentTime - lastTime) / (double)SDL_GetPerformanceFrequency());
+		lastTime = currentTime;
+		if (frame_index > 0)
+			RecordFrameTime(frame_seconds * 1000.0f);
+		deltaTime = (headless.enabled || benchmark.enabled) ? FIXED_DT : frame_seconds;
+
+
+
+		// poll events
+		{
+			PROFILE_SCOPE("Events");
+			while (SDL_PollEvent(&event))
+			{
+				switch (event.type)
+				{
+				case SDL_EVENT_MOUSE_MOTION:
+				{
+				}
+				break;
+				case SDL_EVENT_MOUSE_BUTTON_DOWN:
+				{
+					if (ray_stats_enabled && event.button.button == SDL_BUTTON_LEFT && !ImGui::GetIO().WantCaptureMouse)
+						InspectRayAt(renderer, event.button.x, event.button.y);
+				}
+				break;
+				case SDL_EVENT_MOUSE_WHEEL:
+				{
+				}
+				case SDL_EVENT_KEY_DOWN:
+				{
+					if (event.key.key == SDLK_W)
+						player.walk_direction = +1;
+					if (event.key.key == SDLK_S)
+						player.walk_direction = -1;
+					if (event.key.key == SDLK_D)
+						player.turn_direction = +1;
+					if (event.key.key == SDLK_A)
+						player.turn_direction = -1;
+					if (event.key.key == SDLK_E && !event.key.repeat)
+						UseDoor(player.x + 0.5f * player.size, player.y + 0.5f * player.size, player.rotation_angle);
+					if (event.key.key == SDLK_F9 && !event.key.repeat && !TraceCaptureBusy())
+						StartTraceCapture(trace_frames);
+				}
+				break;
+				case SDL_EVENT_KEY_UP:
+				{
+					if (event.key.key == SDLK_W)
+						player.walk_direction = 0;
+					if (event.key.key == SDLK_S)
+						player.walk_direction = 0;
+					if (event.key.key == SDLK_D)
+						player.turn_direction = 0;
+					if (event.key.key == SDLK_A)
+						player.turn_direction = 0;
+				}
+				break;
+				case SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED:
+				case SDL_EVENT_WINDOW_DISPLAY_SCALE_CHANGED:
+				{
+					ApplyWindowSize(window, renderer);
+				}
+				break;
+				case SDL_EVENT_RENDER_TARGETS_RESET:
+				{
+					MarkMinimapDirty();
+				}
+				break;
+				case SDL_EVENT_WINDOW_CLOSE_REQUESTED:
+				{
+					is_window_running = false;
+				}
+				break;
+				default:
+					break;
+				}
+
+				if (!headless.enabled)
+					ImGui_ImplSDL3_ProcessEvent(&event);
+			}
+		}
+
+		// update
+		{
+			PROFILE_SCOPE("Update");
+			if (benchmark.enabled)
+			{
+				ApplyCameraPath(benchmark.time);
+				benchmark.time += deltaTime;
+			}
+			else
+			{
+				player.Update(deltaTime);
+			}
+			UpdateDoors(deltaTime, player.x, player.y, player.size);
+		}
+
+		// render
+
+		if (!headless.enabled)
 		{
-			float rayAngle = player.rotation_angle - (FOV_ANGLE / 2.0f);
+			PROFILE_SCOPE("ImGui NewFrame");
+			ImGui_ImplSDLRenderer3_NewFrame();
+			ImGui_ImplSDL3_NewFrame();
+			ImGui::NewFrame();
+		}
 
-			for (int stripId = 0; stripId < NUM_RAYS; stripId++)
+		// clear screen
+		UpdateMinimapTexture(renderer);
+
+		SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);  // black
+		SDL_RenderClear(renderer);
+		
+		// color buffer
+		if (pipelined_frames)
+		{
+			RenderPipelinedColorBuffer(renderer);
+		}
+		else
+		{
+			LockColorBuffer();
 			{
-				rays[stripId].x = player.x;
-				rays[stripId].y = player.y;
-				rays[stripId].rotation_angle = rayAngle;
-
-				rays[stripId].Cast();
-				rays[stripId].Render(renderer);
-				
-				rayAngle += FOV_ANGLE / NUM_RAYS;
+				PROFILE_SCOPE("Raster");
+				AllocationScope alloc_scope(ALLOC_RASTER, true);
+				ResetPassCounters();
+				uint64_t raster_start = SDL_GetPerformanceCounter();
+				ClearColorBuffer(raster_clear_color);
+				Render3DProjectWalls();
+				Render3DProjectSprites();
+				if (overdraw_view)
+					ResolveOverdrawColumns(0, render_width);
+				raster_ms = ElapsedMs(raster_start);
 			}
+			RenderColorBuffer(renderer);
 		}
+		RenderRayHeatmap(renderer);
+
+
+		// draw map
+		RenderMinimap(renderer);
+		// draw player
+		RenderPlayer(renderer);
+
+		// cast all rays
+		uint64_t cast_start = SDL_GetPerformanceCounter();
+		CastAllRays();
+		ray_cast_ms = ElapsedMs(cast_start);
+		ProjectSprites();
+		cast_ms = ElapsedMs(cast_start);
+		RenderRayFan(renderer);
+		RenderRayTrace(renderer);
 
 		/*
 		ray.x = player.x; ray.y = player.y; ray.rotation_angle = player.rotation_angle;
 		ray.Cast();
-		ray.Render(renderer);
+		RenderRay(renderer, ray);
 		*/
 
-		ImGui::Begin("Performance Debug");
-		ImGui::Text("Delta Time: %.4f sec", deltaTime);
-		ImGui::Text("FPS: %.1f", 1.0f / deltaTime);
-		ImGui::End();
+		if (!headless.enabled)
+		{
+			DrawPerformanceDebugWindow();
+			DrawProfilerWindow();
+			DrawRayInspectorWindow();
+		}
+
+		// raster the next frame while this one is submitted and presented
+		if (pipelined_frames)
+			KickRasterJob();
+
+		if (!headless.enabled)
+		{
+			PROFILE_SCOPE("ImGui Render");
+			ImGui::Render();
+			ImGui_ImplSDLRenderer3_RenderDrawData(ImGui::GetDrawData(), renderer);
+		}
+		else if (headless.dump_prefix && frame_index % headless.dump_every == 0)
+		{
+			DumpFrame(renderer, frame_index);
+		}
+		{
+			PROFILE_SCOPE("Present");
+			SDL_RenderPresent(renderer);
+		}
+		ProfilerEndFrame();
+		EndAllocationFrame();
+		if (trace_capture.complete)
+			FinishTraceCapture(frame_index);
+
+		if (benchmark.enabled)
+		{
+			RecordBenchmarkFrame(ElapsedMs(frame_start));
+			if (BenchmarkFinished())
+				is_window_running = false;
+		}
+		else if (headless.enabled)
+		{
+			headless_frame_ms += ElapsedMs(frame_start);
+			headless_cast_ms += cast_ms;
+			headless_raster_ms += raster_ms;
+			if (frame_index + 1 >= headless.frames)
+				is_window_running = false;
+		}
+		RecordHitchFrame(frame_index, ElapsedMs(frame_start));
+		RecordTelemetryFrame(frame_index, frame_start);
+		frame_index++;
+	}
+
+	if (benchmark.enabled)
+		WriteBenchmarkReport();
+
+	// the run ended before the capture did, keep what we have
+	if (trace_capture.active)
+		FinishTraceCapture(frame_index);
 
-		ImGui::Render();
-		ImGui_ImplSDLRenderer3_RenderDrawData(ImGui::GetDrawData(), renderer);
-		SDL_RenderPresent(renderer);
+	if (headless.enabled && !benchmark.enabled)
+	{
+		std::cout << "Headless: " << frame_index << " frames at " << render_width << " x " << render_height
+			<< ", frame " << headless_frame_ms / frame_index << " ms"
+			<< ", cast " << headless_cast_ms / frame_index << " ms"
+			<< ", raster " << headless_raster_ms / frame_index << " ms\n";
 	}
 
-	free(color_buffer);
-	SDL_DestroyTexture(color_buffer_texture);
+	WaitRasterJob();
+	ShutdownRasterWorkers();
+	ShutdownHitchCapture();
+	CloseTelemetryFile(telemetry);
+	ReportAllocationBudgets();
+
+	frame_arena.Release();
+	for (int i = 0; i < COLOR_BUFFER_TEXTURE_COUNT; i++)
+	{
+		SDL_DestroyTexture(color_buffer_textures[i]);
+	}
+	SDL_DestroyTexture(minimap_texture);
 	SDL_DestroyRenderer(renderer);
-	SDL_DestroyWindow(window);
+	if (window)
+		SDL_DestroyWindow(window);
+	if (headless_surface)
+		SDL_DestroySurface(headless_surface);
 	SDL_Quit();
 
 	return 0;
@@ -0,0 +1,481 @@
+﻿#pragma once
+
+// hierarchical scope profiler: PROFILE_SCOPE("name") times the enclosing block with
+// SDL_GetPerformanceCounter into a ring owned by the calling thread, nesting depth is
+// tracked per thread so no locks are taken. frames are time ranges marked by
+// ProfilerBeginFrame / ProfilerEndFrame on the main thread.
+// build with PROFILER_ENABLED 0 and every scope compiles to nothing.
+// on linux, PROFILER_PERF_COUNTERS 1 also reads hardware counters around every scope. the
+// project only ships a visual studio build, so this needs a linux build of the game to be useful
+#include <SDL3/SDL.h>
+
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 1
+#endif
+
+#if !defined(PROFILER_PERF_COUNTERS) || !defined(__linux__) || !PROFILER_ENABLED
+#undef PROFILER_PERF_COUNTERS
+#define PROFILER_PERF_COUNTERS 0
+#endif
+
+#if PROFILER_PERF_COUNTERS
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#define PROFILER_MAX_THREADS 16
+#define PROFILER_RING_SIZE 8192 // zones per thread, power of two, the main thread keeps ~300 frames
+#define PROFILER_FRAME_HISTORY 300
+
+enum HardwareCounter
+{
+	HW_CYCLES,
+	HW_INSTRUCTIONS,
+	HW_L1D_MISSES,
+	HW_LLC_MISSES,
+	HW_BRANCH_MISSES,
+	HW_COUNTER_COUNT
+};
+
+// all zones with one name that ended inside a frame, summed over every thread
+struct ProfilerZoneTotals
+{
+	int calls;
+	uint64_t ticks;
+	uint64_t counters[HW_COUNTER_COUNT]; // zero without PROFILER_PERF_COUNTERS
+};
+
+inline bool hardware_counters_available = false; // set when the first registered thread, main, opened its counters
+
+struct TraceEvent
+{
+	const char* name;
+	uint64_t start, end;
+	int thread;
+};
+
+#if PROFILER_ENABLED
+
+struct ProfilerZone
+{
+	const char* name; // string literal, compared by pointer
+	uint64_t start, end;
+	int depth;
+#if PROFILER_PERF_COUNTERS
+	uint64_t counters[HW_COUNTER_COUNT]; // deltas over the zone, inner zones and their reads included
+#endif
+};
+
+struct ProfilerThread
+{
+	char name[32];
+	ProfilerZone zones[PROFILER_RING_SIZE]; // ordered by end time
+	SDL_AtomicInt zone_count;               // zones ever written, the next goes to zone_count % PROFILER_RING_SIZE
+	int depth;
+#if PROFILER_PERF_COUNTERS
+	int perf_fd = -1;                         // group leader, one read() returns every counter
+	int perf_slot[HW_COUNTER_COUNT];          // position in the group read, -1 when the counter failed to open
+#endif
+};
+
+struct ProfilerFrame
+{
+	uint64_t start, end;
+};
+
+struct Profiler
+{
+	ProfilerThread threads[PROFILER_MAX_THREADS];
+	SDL_AtomicInt thread_count;
+	ProfilerFrame frames[PROFILER_FRAME_HISTORY];
+	int frame_count = 0; // frames ever ended
+	uint64_t frame_start = 0;
+	bool frame_continues = false; // the next frame starts where the last ended
+	SDL_AtomicInt paused; // nothing is recorded while set, the history stays as it was
+};
+
+inline Profiler profiler;
+inline thread_local ProfilerThread* profiler_thread = nullptr;
+
+#if PROFILER_PERF_COUNTERS
+// counts the calling thread on whatever cpu it runs, user space only
+inline int OpenHardwareCounter(uint32_t type, uint64_t config, int group_fd)
+{
+	perf_event_attr attr = {};
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = group_fd == -1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP;
+	return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+
+inline void OpenHardwareCounters(ProfilerThread& thread)
+{
+	const uint32_t types[HW_COUNTER_COUNT] = { PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE };
+	const uint64_t configs[HW_COUNTER_COUNT] = {
+		PERF_COUNT_HW_CPU_CYCLES,
+		PERF_COUNT_HW_INSTRUCTIONS,
+		PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+		PERF_COUNT_HW_CACHE_MISSES,
+		PERF_COUNT_HW_BRANCH_MISSES,
+	};
+
+	// cycles leads the group, without it nothing is read (perf_event_paranoid, no pmu in a vm)
+	thread.perf_fd = OpenHardwareCounter(types[HW_CYCLES], configs[HW_CYCLES], -1);
+	if (thread.perf_fd < 0)
+		return;
+
+	int slots = 0;
+	thread.perf_slot[HW_CYCLES] = slots++;
+	for (int c = HW_CYCLES + 1; c < HW_COUNTER_COUNT; c++)
+	{
+		thread.perf_slot[c] = OpenHardwareCounter(types[c], configs[c], thread.perf_fd) >= 0 ? slots++ : -1;
+	}
+	ioctl(thread.perf_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+}
+
+inline void ReadHardwareCounters(const ProfilerThread& thread, uint64_t* counters)
+{
+	uint64_t data[1 + HW_COUNTER_COUNT] = {}; // nr, then one value per open counter
+	if (thread.perf_fd < 0 || read(thread.perf_fd, data, sizeof(data)) <= 0)
+	{
+		SDL_memset(counters, 0, sizeof(uint64_t) * HW_COUNTER_COUNT);
+		return;
+	}
+	for (int c = 0; c < HW_COUNTER_COUNT; c++)
+	{
+		counters[c] = thread.perf_slot[c] >= 0 ? data[1 + thread.perf_slot[c]] : 0;
+	}
+}
+#endif
+
+// call once at the start of every thread that has scopes, threads that never register record nothing
+inline void ProfilerRegisterThread(const char* name)
+{
+	int index = SDL_AddAtomicInt(&profiler.thread_count, 1);
+	if (index >= PROFILER_MAX_THREADS)
+		return;
+
+	ProfilerThread& thread = profiler.threads[index];
+	SDL_strlcpy(thread.name, name, sizeof(thread.name));
+	profiler_thread = &thread;
+
+#if PROFILER_PERF_COUNTERS
+	OpenHardwareCounters(thread);
+	if (index == 0)
+		hardware_counters_available = thread.perf_fd >= 0;
+#endif
+}
+
+inline int ProfilerThreadCount()
+{
+	return SDL_min(SDL_GetAtomicInt(&profiler.thread_count), PROFILER_MAX_THREADS);
+}
+
+inline bool ProfilerPaused()
+{
+	return SDL_GetAtomicInt(&profiler.paused) != 0;
+}
+
+struct ProfileScope
+{
+	ProfilerThread* thread;
+	const char* name;
+	uint64_t start;
+	int depth;
+#if PROFILER_PERF_COUNTERS
+	uint64_t counters[HW_COUNTER_COUNT];
+#endif
+
+	ProfileScope(const char* scope_name)
+		: thread(profiler_thread), name(scope_name), start(0), depth(0)
+	{
+		if (!thread || ProfilerPaused())
+		{
+			thread = nullptr;
+			return;
+		}
+		depth = thread->depth++;
+#if PROFILER_PERF_COUNTERS
+		ReadHardwareCounters(*thread, counters);
+#endif
+		start = SDL_GetPerformanceCounter();
+	}
+
+	~ProfileScope()
+	{
+		if (!thread)
+			return;
+
+		uint64_t end = SDL_GetPerformanceCounter();
+		thread->depth--;
+
+		// only this thread writes its ring, readers see the zone once zone_count moves past it
+		int count = SDL_GetAtomicInt(&thread->zone_count);
+		ProfilerZone& zone = thread->zones[(uint32_t)count % PROFILER_RING_SIZE];
+		zone.name = name;
+		zone.start = start;
+		zone.end = end;
+		zone.depth = depth;
+#if PROFILER_PERF_COUNTERS
+		uint64_t now[HW_COUNTER_COUNT];
+		ReadHardwareCounters(*thread, now);
+		for (int c = 0; c < HW_COUNTER_COUNT; c++)
+		{
+			zone.counters[c] = now[c] - counters[c];
+		}
+#endif
+		SDL_SetAtomicInt(&thread->zone_count, count + 1);
+	}
+};
+
+// zones are attributed to the frame they end in, so a zone is never counted twice
+inline ProfilerZoneTotals SumProfilerZones(const ProfilerFrame& frame, const char* name)
+{
+	ProfilerZoneTotals totals = {};
+	for (int t = 0; t < ProfilerThreadCount(); t++)
+	{
+		const ProfilerThread& thread = profiler.threads[t];
+		uint32_t count = (uint32_t)SDL_GetAtomicInt((SDL_AtomicInt*)&thread.zone_count);
+		uint32_t oldest = count > PROFILER_RING_SIZE ? count - PROFILER_RING_SIZE : 0;
+		for (uint32_t i = count; i > oldest; i--)
+		{
+			const ProfilerZone& zone = thread.zones[(i - 1) % PROFILER_RING_SIZE];
+			if (zone.end <= frame.start)
+				break;
+			if (zone.end > frame.end || SDL_strcmp(zone.name, name) != 0)
+				continue;
+
+			totals.calls++;
+			totals.ticks += zone.end - zone.start;
+#if PROFILER_PERF_COUNTERS
+			for (int c = 0; c < HW_COUNTER_COUNT; c++)
+			{
+				totals.counters[c] += zone.counters[c];
+			}
+#endif
+		}
+	}
+	return totals;
+}
+
+inline ProfilerZoneTotals SumLastFrameZones(const char* name)
+{
+	if (profiler.frame_count == 0)
+		return {};
+	return SumProfilerZones(profiler.frames[(profiler.frame_count - 1) % PROFILER_FRAME_HISTORY], name);
+}
+
+//////////////////// TraceCapture ///////////////////////
+// copies every zone of the next N frames out of the thread rings and writes them as Chrome
+// trace events (chrome://tracing, ui.perfetto.dev). the rings are drained once per frame on the
+// main thread so a capture can be longer than PROFILER_RING_SIZE zones, workers never wait on it
+
+struct TraceCapture
+{
+	bool active = false;
+	bool complete = false; // set on the last frame, cleared once the events are handed to a writer
+	int frames_left = 0;
+	uint32_t cursor[PROFILER_MAX_THREADS] = {}; // next zone to copy per thread
+	TraceEvent* events = nullptr;
+	int event_count = 0;
+	int event_capacity = 0;
+	int dropped = 0; // zones overwritten before they were drained
+	uint64_t start = 0;
+};
+
+inline TraceCapture trace_capture;
+
+inline void PushTraceEvent(const char* name, uint64_t start, uint64_t end, int thread)
+{
+	if (trace_capture.event_count == trace_capture.event_capacity)
+	{
+		int capacity = SDL_max(trace_capture.event_capacity * 2, 4096);
+		TraceEvent* events = (TraceEvent*)SDL_realloc(trace_capture.events, sizeof(TraceEvent) * capacity);
+		if (!events)
+		{
+			trace_capture.dropped++;
+			return;
+		}
+		trace_capture.events = events;
+		trace_capture.event_capacity = capacity;
+	}
+	trace_capture.events[trace_capture.event_count++] = { name, start, end, thread };
+}
+
+inline void StartTraceCapture(int frames)
+{
+	trace_capture.active = true;
+	trace_capture.complete = false;
+	trace_capture.frames_left = SDL_max(frames, 1);
+	trace_capture.event_count = 0;
+	trace_capture.dropped = 0;
+	trace_capture.start = SDL_GetPerformanceCounter();
+	for (int t = 0; t < PROFILER_MAX_THREADS; t++)
+	{
+		trace_capture.cursor[t] = (uint32_t)SDL_GetAtomicInt(&profiler.threads[t].zone_count);
+	}
+	SDL_SetAtomicInt(&profiler.paused, 0);
+}
+
+inline void DrainTraceCapture(const ProfilerFrame& frame)
+{
+	for (int t = 0; t < ProfilerThreadCount(); t++)
+	{
+		ProfilerThread& thread = profiler.threads[t];
+		uint32_t count = (uint32_t)SDL_GetAtomicInt(&thread.zone_count);
+		uint32_t& cursor = trace_capture.cursor[t];
+		if (count - cursor > PROFILER_RING_SIZE)
+		{
+			trace_capture.dropped += count - cursor - PROFILER_RING_SIZE;
+			cursor = count - PROFILER_RING_SIZE;
+		}
+		for (; cursor != count; cursor++)
+		{
+			const ProfilerZone& zone = thread.zones[cursor % PROFILER_RING_SIZE];
+			PushTraceEvent(zone.name, zone.start, zone.end, t);
+		}
+	}
+
+	int main_thread = profiler_thread ? (int)(profiler_thread - profiler.threads) : 0;
+	PushTraceEvent("Frame", frame.start, frame.end, main_thread);
+
+	if (--trace_capture.frames_left == 0)
+	{
+		trace_capture.active = false;
+		trace_capture.complete = true;
+	}
+}
+
+// start of the oldest frame still in the history, the rings hold about as much
+inline uint64_t ProfilerHistoryStart()
+{
+	int history = SDL_min(profiler.frame_count, PROFILER_FRAME_HISTORY);
+	return history > 0 ? profiler.frames[(profiler.frame_count - history) % PROFILER_FRAME_HISTORY].start : 0;
+}
+
+// every zone and frame that ended after since, straight from the rings, for dumps of the recent past
+inline int CollectRecentTraceEvents(uint64_t since, TraceEvent* events, int capacity)
+{
+	int count = 0;
+	for (int t = 0; t < ProfilerThreadCount(); t++)
+	{
+		const ProfilerThread& thread = profiler.threads[t];
+		uint32_t zone_count = (uint32_t)SDL_GetAtomicInt((SDL_AtomicInt*)&thread.zone_count);
+		uint32_t oldest = zone_count > PROFILER_RING_SIZE ? zone_count - PROFILER_RING_SIZE : 0;
+		for (uint32_t i = zone_count; i > oldest && count < capacity; i--)
+		{
+			const ProfilerZone& zone = thread.zones[(i - 1) % PROFILER_RING_SIZE];
+			if (zone.end <= since)
+				break;
+			events[count++] = { zone.name, zone.start, zone.end, t };
+		}
+	}
+
+	int frames = SDL_min(profiler.frame_count, PROFILER_FRAME_HISTORY);
+	for (int back = 0; back < frames && count < capacity; back++)
+	{
+		const ProfilerFrame& frame = profiler.frames[(profiler.frame_count - 1 - back) % PROFILER_FRAME_HISTORY];
+		if (frame.end <= since)
+			break;
+		events[count++] = { "Frame", frame.start, frame.end, 0 };
+	}
+	return count;
+}
+
+// thread names are read from the profiler, safe from any thread once registration is done
+inline bool WriteTraceEvents(const char* path, const TraceEvent* events, int event_count, uint64_t origin, int dropped)
+{
+	SDL_IOStream* file = SDL_IOFromFile(path, "wb");
+	if (!file)
+		return false;
+
+	// ts and dur are microseconds, events on one thread nest by time so depth is implied
+	const double tick_us = 1000000.0 / (double)SDL_GetPerformanceFrequency();
+	SDL_IOprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	for (int t = 0; t < ProfilerThreadCount(); t++)
+	{
+		SDL_IOprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}},\n",
+			t, profiler.threads[t].name);
+	}
+	for (int i = 0; i < event_count; i++)
+	{
+		const TraceEvent& event = events[i];
+		SDL_IOprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f},\n",
+			event.name, event.thread,
+			(double)(int64_t)(event.start - origin) * tick_us,
+			(double)(event.end - event.start) * tick_us);
+	}
+	SDL_IOprintf(file, "{\"name\":\"dropped_zones\",\"ph\":\"M\",\"pid\":1,\"args\":{\"count\":%d}}\n]}\n", dropped);
+	return SDL_CloseIO(file);
+}
+
+// the events stay untouched until the next StartTraceCapture, so any thread may write them
+inline bool WriteTraceCapture(const char* path)
+{
+	return WriteTraceEvents(path, trace_capture.events, trace_capture.event_count, trace_capture.start, trace_capture.dropped);
+}
+/////////////////////////////////////////////////////////
+
+// frames tile the timeline, a zone that ends after ProfilerEndFrame but before the next
+// ProfilerBeginFrame (a raster slice of a pipelined frame) still lands in a frame
+inline void ProfilerBeginFrame()
+{
+	if (!profiler.frame_continues)
+		profiler.frame_start = SDL_GetPerformanceCounter();
+}
+
+inline void ProfilerEndFrame()
+{
+	if (ProfilerPaused())
+	{
+		profiler.frame_continues = false;
+		return;
+	}
+
+	ProfilerFrame& frame = profiler.frames[profiler.frame_count % PROFILER_FRAME_HISTORY];
+	frame.start = profiler.frame_start;
+	frame.end = SDL_GetPerformanceCounter();
+	profiler.frame_count++;
+	profiler.frame_start = frame.end;
+	profiler.frame_continues = true;
+
+	if (trace_capture.active)
+		DrainTraceCapture(frame);
+}
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+
+#else
+
+#define PROFILE_SCOPE(name)
+
+struct TraceCapture
+{
+	bool active = false;
+	bool complete = false;
+	int event_count = 0;
+	int dropped = 0;
+};
+
+inline TraceCapture trace_capture;
+
+inline ProfilerZoneTotals SumLastFrameZones(const char*) { return {}; }
+inline void StartTraceCapture(int) {}
+inline bool WriteTraceCapture(const char*) { return false; }
+inline bool ProfilerPaused() { return false; }
+inline uint64_t ProfilerHistoryStart() { return 0; }
+inline int CollectRecentTraceEvents(uint64_t, TraceEvent*, int) { return 0; }
+inline bool WriteTraceEvents(const char*, const TraceEvent*, int, uint64_t, int) { return false; }
+inline void ProfilerRegisterThread(const char*) {}
+inline void ProfilerBeginFrame() {}
+inline void ProfilerEndFrame() {}
+
+#endif
@@ -0,0 +1,810 @@
+﻿#include "raycaster.h"
+#include "profiler.h"
+#include "allocations.h"
+
+float FOV_ANGLE = 60.0f * TORAD;
+
+int output_width = WINDOW_WIDTH;
+int output_height = WINDOW_HEIGHT;
+
+int render_width = WINDOW_WIDTH;
+int render_height = WINDOW_HEIGHT;
+int num_rays = NUM_RAYS;
+
+//////////////////// Map //////////////////////////////
+
+const int map[TILE_ROW_NUM][TILES_COL_NUM] = 
+{
+	{1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1},
+	{1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
+	{1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
+	{1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
+	{1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
+	{1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1},
+	{1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 4, 0, 0, 1},
+	{1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1},
+	{1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 4, 1, 1, 0, 0, 1},
+	{1, 0, 0, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
+	{1, 0, 1, 0, 0, 0, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
+	{1, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1},
+	{1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1}
+};
+
+bool map_tile_dirty[TILE_ROW_NUM][TILES_COL_NUM];
+bool map_dirty = false;
+
+///////////////////////////////////////////////////////
+
+//////////////////// Doors //////////////////////////////
+
+Door doors[MAX_DOORS];
+int door_count = 0;
+uint8_t door_index[TILE_ROW_NUM][TILES_COL_NUM];
+
+void InitDoors()
+{
+	door_count = 0;
+	SDL_memset(door_index, NO_DOOR, sizeof(door_index));
+
+	for (int row = 0; row < TILE_ROW_NUM; row++)
+	{
+		for (int col = 0; col < TILES_COL_NUM; col++)
+		{
+			if (map[row][col] != DOOR_TILE || door_count == MAX_DOORS)
+				continue;
+
+			bool walls_east_west = col > 0 && col < TILES_COL_NUM - 1 && map[row][col - 1] != 0 && map[row][col + 1] != 0;
+
+			Door& door = doors[door_count];
+			door.row = (uint8_t)row;
+			door.col = (uint8_t)col;
+			door.vertical = !walls_east_west;
+			door.state = DoorState::CLOSED;
+			door.open = 0.0f;
+			door.hold = 0.0f;
+			door_index[row][col] = (uint8_t)door_count++;
+		}
+	}
+}
+
+float RayToDoorDistance(const Door& door, float x, float y, float rdx, float rdy)
+{
+	float t, along;
+	if (door.vertical)
+	{
+		if (fabsf(rdx) < 1e-6f)
+			return -1.0f;
+		t = ((door.col + 0.5f) * TILE_SIZE - x) / rdx;
+		along = y + t * rdy - door.row * TILE_SIZE;
+	}
+	else
+	{
+		if (fabsf(rdy) < 1e-6f)
+			return -1.0f;
+		t = ((door.row + 0.5f) * TILE_SIZE - y) / rdy;
+		along = x + t * rdx - door.col * TILE_SIZE;
+	}
+
+	if (t < 0.0f || along < door.open * TILE_SIZE || along >= TILE_SIZE)
+		return -1.0f;
+	return t;
+}
+
+bool DoorBlocks(const Door& door, float x, float y, float radius)
+{
+	float along = door.vertical ? y - door.row * TILE_SIZE : x - door.col * TILE_SIZE;
+	return along + radius > door.open * TILE_SIZE;
+}
+
+bool DoorOccupied(const Door& door, float x, float y, float size)
+{
+	return x < (door.col + 1) * TILE_SIZE && x + size > door.col * TILE_SIZE &&
+		y < (door.row + 1) * TILE_SIZE && y + size > door.row * TILE_SIZE;
+}
+
+void UseDoor(float x, float y, float angle)
+{
+	int col = (int)((x + cosf(angle) * DOOR_REACH) / TILE_SIZE);
+	int row = (int)((y + sinf(angle) * DOOR_REACH) / TILE_SIZE);
+	if (row < 0 || col < 0 || row >= TILE_ROW_NUM || col >= TILES_COL_NUM || door_index[row][col] == NO_DOOR)
+		return;
+
+	Door& door = doors[door_index[row][col]];
+	if (door.state == DoorState::CLOSED || door.state == DoorState::CLOSING)
+		door.state = DoorState::OPENING;
+	else if (door.state == DoorState::OPEN)
+		door.hold = 0.0f;
+}
+
+void UpdateDoors(float dt, float x, float y, float size)
+{
+	for (int i = 0; i < door_count; i++)
+	{
+		Door& door = doors[i];
+		bool was_closed = door.open < 1.0f;
+		switch (door.state)
+		{
+		case DoorState::OPENING:
+			door.open += dt / DOOR_SLIDE_TIME;
+			if (door.open >= 1.0f)
+			{
+				door.open = 1.0f;
+				door.hold = DOOR_HOLD_TIME;
+				door.state = DoorState::OPEN;
+			}
+			break;
+		case DoorState::OPEN:
+			door.hold -= dt;
+			if (door.hold <= 0.0f && !DoorOccupied(door, x, y, size))
+				door.state = DoorState::CLOSING;
+			break;
+		case DoorState::CLOSING:
+			if (DoorOccupied(door, x, y, size))
+			{
+				door.state = DoorState::OPENING;
+				break;
+			}
+			door.open -= dt / DOOR_SLIDE_TIME;
+			if (door.open <= 0.0f)
+			{
+				door.open = 0.0f;
+				door.state = DoorState::CLOSED;
+			}
+			break;
+		default:
+			break;
+		}
+
+		if ((door.open < 1.0f) != was_closed)
+			MarkMapTileDirty(door.row, door.col);
+	}
+}
+
+///////////////////////////////////////////////////////
+
+//////////////////// Player /////////////////////////////
+
+Player player;
+
+void Player::Update(float dt)
+{
+	rotation_angle += turn_speed * turn_direction * dt;
+
+	float new_x = x + cosf(rotation_angle) * wlak_speed * walk_direction * dt;
+	float new_y = y + sinf(rotation_angle) * wlak_speed * walk_direction * dt;
+
+	// collision detection
+	int player_pos_at_map_col = floor((new_x + 0.5f * size) / TILE_SIZE);
+	int player_pos_at_map_raw = floor((new_y + 0.5f * size) / TILE_SIZE);
+	int tile = map[player_pos_at_map_raw][player_pos_at_map_col];
+
+	bool blocked = tile == 1;
+	if (tile == DOOR_TILE)
+	{
+		const Door& door = doors[door_index[player_pos_at_map_raw][player_pos_at_map_col]];
+		blocked = DoorBlocks(door, new_x + 0.5f * size, new_y + 0.5f * size, 0.5f * size);
+	}
+
+	if (!blocked)
+	{
+		x = new_x;
+		y = new_y;
+	}
+}
+
+/////////////////////////////////////////////////////////
+
+//////////////////// Colormap ///////////////////////////
+
+uint32_t wall_colors[WALL_COLOR_COUNT] = { 0xFF000000, 0xFFFFFFFF, 0xFFB0413E, 0xFF3E6FB0, 0xFF8C5A2B };
+uint32_t fog_color = 0xFF181A19;
+float fog_start_distance = 256.0f;
+float max_view_distance = 1280.0f;
+float side_darkening = 0.8f;
+uint32_t colormap[2][COLORMAP_BANDS][WALL_COLOR_COUNT];
+uint8_t colormap_indices[2][COLORMAP_BANDS][WALL_COLOR_COUNT];
+float colormap_band_scale = 0.0f;
+
+uint32_t palette[256];
+int palette_size = 0;
+uint32_t display_palette[256];
+float palette_fade = 0.0f;
+float palette_flash = 0.0f;
+
+uint32_t LerpColor(uint32_t a, uint32_t b, float t)
+{
+	uint32_t result = 0xFF000000;
+	for (int shift = 0; shift < 24; shift += 8)
+	{
+		float ca = (float)((a >> shift) & 0xFF);
+		float cb = (float)((b >> shift) & 0xFF);
+		result |= (uint32_t)(ca + (cb - ca) * t + 0.5f) << shift;
+	}
+	return result;
+}
+
+uint8_t NearestPaletteIndex(uint32_t color)
+{
+	int best = 0;
+	int best_error = INT32_MAX;
+	for (int i = 0; i < palette_size && best_error > 0; i++)
+	{
+		int error = 0;
+		for (int shift = 0; shift < 24; shift += 8)
+		{
+			error += SDL_abs((int)((palette[i] >> shift) & 0xFF) - (int)((color >> shift) & 0xFF));
+		}
+		if (error < best_error)
+		{
+			best_error = error;
+			best = i;
+		}
+	}
+	return (uint8_t)best;
+}
+
+uint8_t AddPaletteColor(uint32_t color)
+{
+	uint8_t index = NearestPaletteIndex(color);
+	if (palette_size == 0 || palette[index] != color)
+	{
+		if (palette_size == 256)
+			return index; // palette is full, settle for the nearest entry
+
+		palette[palette_size] = color;
+		index = (uint8_t)palette_size++;
+	}
+	return index;
+}
+
+void UpdateDisplayPalette()
+{
+	for (int i = 0; i < palette_size; i++)
+	{
+		uint32_t color = LerpColor(palette[i], 0xFFFF0000, palette_flash);
+		display_palette[i] = LerpColor(color, 0xFF000000, palette_fade);
+	}
+}
+
+void BuildColormap()
+{
+	palette_size = 0;
+	AddPaletteColor(fog_color);
+
+	// ahead of the colormap, which alone can fill the palette
+	for (int c = 0; c < OVERDRAW_COLOR_COUNT; c++)
+	{
+		overdraw_color_indices[c] = AddPaletteColor(overdraw_colors[c]);
+	}
+
+	for (int side = 0; side < 2; side++)
+	{
+		for (int band = 0; band < COLORMAP_BANDS; band++)
+		{
+			float fog = (float)band / (COLORMAP_BANDS - 1);
+			for (int c = 0; c < WALL_COLOR_COUNT; c++)
+			{
+				uint32_t lit = side ? LerpColor(wall_colors[c], 0xFF000000, 1.0f - side_darkening) : wall_colors[c];
+				colormap[side][band][c] = LerpColor(lit, fog_color, fog);
+				colormap_indices[side][band][c] = AddPaletteColor(colormap[side][band][c]);
+			}
+		}
+	}
+
+	colormap_band_scale = (COLORMAP_BANDS - 1) / SDL_max(max_view_distance - fog_start_distance, 1.0f);
+}
+
+/////////////////////////////////////////////////////////
+
+//////////////////// RayStats ///////////////////////////
+
+bool ray_stats_enabled = false;
+RayStats* ray_stats = nullptr;
+RayHeatmap ray_heatmap = RayHeatmap::OFF;
+bool ray_heatmap_on_view = true;
+bool ray_heatmap_on_fan = true;
+int inspected_ray = -1;
+RayTrace ray_trace;
+RayFrameTotals ray_frame_totals;
+
+void SumRayStats()
+{
+	RayFrameTotals totals = {};
+	totals.rays = num_rays;
+	for (int i = 0; i < num_rays; i++)
+	{
+		const RayStats& stats = ray_stats[i];
+		totals.cells_visited += stats.cells_visited;
+		totals.intersection_tests += stats.intersection_tests;
+		totals.early_exits += stats.early_exit;
+		totals.pixels += stats.pixels;
+		totals.max_cells_visited = SDL_max(totals.max_cells_visited, (int)stats.cells_visited);
+		totals.max_intersection_tests = SDL_max(totals.max_intersection_tests, (int)stats.intersection_tests);
+	}
+	ray_frame_totals = totals;
+}
+
+/////////////////////////////////////////////////////////
+
+//////////////////// Ray ////////////////////////////////
+bool Ray::HitDoor(int raw, int col, float rdx, float rdy)
+{
+	const Door& door = doors[door_index[raw][col]];
+	float dist = RayToDoorDistance(door, x, y, rdx, rdy);
+	if (dist < 0.0f)
+		return false;
+
+	if (dist <= max_view_distance && dist < min_intersection_dist)
+	{
+		min_intersection_dist = dist;
+		intersection_x = x + rdx * dist;
+		intersection_y = y + rdy * dist;
+		was_vertical_hit = door.vertical;
+		wall_type = DOOR_TILE;
+	}
+	return true;
+}
+
+void Ray::Cast()
+{
+	Traverse<false>(nullptr, nullptr);
+}
+
+template <bool record>
+void Ray::Traverse(RayStats* stats, RayTrace* trace)
+{
+	int cells_visited = 0;
+	int intersection_tests = 0;
+	RayExit horizontal_exit = RayExit::MAP_EDGE;
+	RayExit vertical_exit = RayExit::MAP_EDGE;
+
+	min_intersection_dist = INFINITY;
+	was_fogged = false;
+	wall_type = 0;
+
+	float normalized_angle = NormalizeAngle(rotation_angle);
+	isRayFacingDown = normalized_angle > 0 && normalized_angle < PI;
+	isRayFacingUp = !isRayFacingDown;
+
+	isRayFacingRight = normalized_angle < 0.5 * PI || normalized_angle > 1.5 * PI;
+	isRayFacingLeft = !isRayFacingRight;
+
+	float rdx = cosf(rotation_angle);
+	float rdy = sinf(rotation_angle);
+
+	// standing in a doorway the panel can be nearer than the first grid line
+	int start_raw = (int)(y / TILE_SIZE);
+	int start_col = (int)(x / TILE_SIZE);
+	if (map[start_raw][start_col] == DOOR_TILE)
+	{
+		bool door_hit = HitDoor(start_raw, start_col, rdx, rdy) && min_intersection_dist != INFINITY;
+		cells_visited++;
+		intersection_tests++;
+		if (record)
+			TraceRayStep(trace, start_raw, start_col, min_intersection_dist, false, door_hit);
+		if (door_hit)
+		{
+			if (record)
+				*stats = { (uint16_t)cells_visited, (uint16_t)intersection_tests, stats->pixels, RayExit::DOOR, RayExit::DOOR, false };
+			return;
+		}
+	}
+
+	// horizontal intersections, nearest grid line first so we can stop at
+	// the first wall or once the ray is fully fogged
+	int row_step = isRayFacingDown ? 1 : -1;
+	int first_row = isRayFacingDown ? (int)ceilf(y / TILE_SIZE) : (int)floorf(y / TILE_SIZE);
+	for (int i = first_row; i >= 0 && i < TILE_ROW_NUM; i += row_step)
+	{
+		auto hit = RayToLineIntersection(
+			x, y,
+			rdx, rdy,
+			0.0f, TILE_SIZE * i, WINDOW_WIDTH, TILE_SIZE * i);
+		intersection_tests++;
+
+		if (!hit.hit)
+			break;
+
+		float dist = Distance(x, y, hit.x, hit.y);
+		if (dist > max_view_distance)
+		{
+			horizontal_exit = RayExit::FOG;
+			break;
+		}
+
+		int col = floor(hit.x / TILE_SIZE);
+		int raw = i;
+
+		if (isRayFacingUp)
+			raw = i - 1;
+
+		if (raw < 0 || col < 0 || raw >= TILE_ROW_NUM || col >= TILES_COL_NUM)
+			break;
+
+		cells_visited++;
+		if (map[raw][col] != 0)
+		{
+			if (map[raw][col] == DOOR_TILE)
+			{
+				intersection_tests++;
+				bool door_hit = HitDoor(raw, col, rdx, rdy);
+				if (record)
+					TraceRayStep(trace, raw, col, dist, false, door_hit);
+				if (door_hit)
+				{
+					horizontal_exit = RayExit::DOOR;
+					break;
+				}
+				continue;
+			}
+
+			if (record)
+				TraceRayStep(trace, raw, col, dist, false, false);
+			min_intersection_dist = dist;
+			intersection_x = hit.x;
+			intersection_y = hit.y;
+			was_vertical_hit = false;
+			wall_type = map[raw][col];
+			horizontal_exit = RayExit::WALL;
+			break;
+		}
+		if (record)
+			TraceRayStep(trace, raw, col, dist, false, false);
+	}
+
+	// vertical intersections
+	int col_step = isRayFacingRight ? 1 : -1;
+	int first_col = isRayFacingRight ? (int)ceilf(x / TILE_SIZE) : (int)floorf(x / TILE_SIZE);
+	for (int i = first_col; i >= 0 && i < TILES_COL_NUM; i += col_step)
+	{
+		auto hit = RayToLineIntersection(
+			x, y,
+			rdx, rdy,
+			TILE_SIZE * i, 0.0f, TILE_SIZE * i, WINDOW_HEIGHT);
+		intersection_tests++;
+
+		if (!hit.hit)
+			break;
+
+		// already beaten by a horizontal hit (or fogged), further lines only get farther
+		float dist = Distance(x, y, hit.x, hit.y);
+		if (dist > max_view_distance || dist >= min_intersection_dist)
+		{
+			vertical_exit = dist >= min_intersection_dist ? RayExit::BEATEN : RayExit::FOG;
+			break;
+		}
+
+		int raw = floor(hit.y / TILE_SIZE);
+		int col = i;
+
+		if (isRayFacingLeft)
+			col = i - 1;
+
+		if (raw < 0 || col < 0 || raw >= TILE_ROW_NUM || col >= TILES_COL_NUM)
+			break;
+
+		cells_visited++;
+		if (map[raw][col] != 0)
+		{
+			if (map[raw][col] == DOOR_TILE)
+			{
+				intersection_tests++;
+				bool door_hit = HitDoor(raw, col, rdx, rdy);
+				if (record)
+					TraceRayStep(trace, raw, col, dist, true, door_hit);
+				if (door_hit)
+				{
+					vertical_exit = RayExit::DOOR;
+					break;
+				}
+				continue;
+			}
+
+			if (record)
+				TraceRayStep(trace, raw, col, dist, true, false);
+			min_intersection_dist = dist;
+			intersection_x = hit.x;
+			intersection_y = hit.y;
+			was_vertical_hit = true;
+			wall_type = map[raw][col];
+			vertical_exit = RayExit::WALL;
+			break;
+		}
+		if (record)
+			TraceRayStep(trace, raw, col, dist, true, false);
+	}
+
+	if (min_intersection_dist == INFINITY)
+	{
+		// nothing within view distance, the column is drawn as pure fog
+		was_fogged = true;
+		min_intersection_dist = max_view_distance;
+		intersection_x = x + rdx * max_view_distance;
+		intersection_y = y + rdy * max_view_distance;
+	}
+
+	if (record)
+	{
+		bool early_exit = horizontal_exit == RayExit::FOG || vertical_exit == RayExit::FOG || vertical_exit == RayExit::BEATEN;
+		*stats = { (uint16_t)cells_visited, (uint16_t)intersection_tests, stats->pixels, horizontal_exit, vertical_exit, early_exit };
+	}
+}
+
+Ray ray;
+Ray* rays = nullptr;
+
+void CastAllRays()
+{
+	PROFILE_SCOPE("Cast");
+	AllocationScope alloc_scope(ALLOC_CAST, true);
+	float rayAngle = player.rotation_angle - (FOV_ANGLE / 2.0f);
+
+	for (int stripId = 0; stripId < num_rays; stripId++)
+	{
+		rays[stripId].x = player.x;
+		rays[stripId].y = player.y;
+		rays[stripId].rotation_angle = rayAngle;
+
+		if (ray_stats_enabled)
+		{
+			RayTrace* trace = stripId == inspected_ray ? &ray_trace : nullptr;
+			if (trace)
+				trace->count = 0;
+			rays[stripId].Traverse<true>(&ray_stats[stripId], trace);
+		}
+		else
+		{
+			rays[stripId].Cast();
+		}
+
+		rayAngle += FOV_ANGLE / num_rays;
+	}
+
+	if (ray_stats_enabled)
+		SumRayStats();
+}
+
+/////////////////////////////////////////////////////////
+
+//////////////////// ColorBuffer ////////////////////////
+
+uint32_t* color_buffer = nullptr;
+uint32_t* color_buffer_memory[2] = {};
+int color_buffer_stride = WINDOW_WIDTH;
+ColorBufferLayout color_buffer_layout = ColorBufferLayout::ROW_MAJOR;
+float* depth_buffer = nullptr;
+bool indexed_color_buffer = false;
+
+//////////////////// PassCounters ///////////////////////
+
+const char* raster_pass_names[PASS_COUNT] = { "Clear", "Walls", "Sprites", "Upload" };
+
+SDL_SpinLock pass_lock = 0;
+PassCounter pass_totals[PASS_COUNT];
+PassCounter pass_counters[PASS_COUNT];
+
+bool overdraw_view = false;
+uint8_t* overdraw_buffer = nullptr;
+
+void ResetPassCounters()
+{
+	SDL_LockSpinlock(&pass_lock);
+	for (int p = 0; p < PASS_COUNT; p++)
+	{
+		pass_counters[p] = pass_totals[p];
+		pass_totals[p] = {};
+	}
+	SDL_UnlockSpinlock(&pass_lock);
+}
+
+const uint32_t overdraw_colors[OVERDRAW_COLOR_COUNT] = { 0xFF000000, 0xFF1F3FBF, 0xFF2FAF3F, 0xFFDFDF2F, 0xFFEF8F1F, 0xFFDF1F1F, 0xFFFFFFFF };
+uint8_t overdraw_color_indices[OVERDRAW_COLOR_COUNT];
+
+void ResolveOverdrawColumns(int first_column, int last_column)
+{
+	for (int y = 0; y < render_height; y++)
+	{
+		const uint8_t* counts = &overdraw_buffer[(render_width * y)];
+		for (int x = first_column; x < last_column; x++)
+		{
+			int count = SDL_min((int)counts[x], OVERDRAW_COLOR_COUNT - 1);
+			if (indexed_color_buffer)
+				IndexedColorBuffer()[(render_width * y) + x] = overdraw_color_indices[count];
+			else if (color_buffer_layout == ColorBufferLayout::COLUMN_MAJOR)
+				color_buffer[(render_height * x) + y] = overdraw_colors[count];
+			else
+				color_buffer[(color_buffer_stride * y) + x] = overdraw_colors[count];
+		}
+	}
+}
+/////////////////////////////////////////////////////////
+
+void ClearColorBufferColumns(uint32_t color, int first_column, int last_column)
+{
+	int64_t pixels_written = (int64_t)render_height * (last_column - first_column);
+	CountPass(PASS_CLEAR, pixels_written, pixels_written * ColorBufferBytesPerPixel());
+	if (overdraw_view)
+	{
+		for (int y = 0; y < render_height; y++)
+		{
+			SDL_memset(&overdraw_buffer[(render_width * y) + first_column], 1, last_column - first_column);
+		}
+	}
+
+	if (indexed_color_buffer)
+	{
+		uint8_t index = NearestPaletteIndex(color);
+		for (int y = 0; y < render_height; y++)
+		{
+			SDL_memset(&IndexedColorBuffer()[(render_width * y) + first_column], index, last_column - first_column);
+		}
+		return;
+	}
+
+	if (color_buffer_layout == ColorBufferLayout::COLUMN_MAJOR)
+	{
+		for (size_t i = (size_t)render_height * first_column; i < (size_t)render_height * last_column; i++)
+		{
+			color_buffer[i] = color;
+		}
+		return;
+	}
+
+	for (int y = 0; y < render_height; y++)
+	{
+		uint32_t* row = &color_buffer[(color_buffer_stride * y)];
+		for (int x = first_column; x < last_column; x++)
+		{
+			row[x] = color;
+		}
+	}
+}
+
+void ClearColorBuffer(uint32_t color)
+{
+	ClearColorBufferColumns(color, 0, render_width);
+}
+
+#ifdef SDL_SSE2_INTRINSICS
+inline void Transpose4x4(const uint32_t* src, size_t src_stride, uint32_t* dst, size_t dst_stride)
+{
+	__m128i r0 = _mm_loadu_si128((const __m128i*)(src + 0 * src_stride));
+	__m128i r1 = _mm_loadu_si128((const __m128i*)(src + 1 * src_stride));
+	__m128i r2 = _mm_loadu_si128((const __m128i*)(src + 2 * src_stride));
+	__m128i r3 = _mm_loadu_si128((const __m128i*)(src + 3 * src_stride));
+
+	__m128i t0 = _mm_unpacklo_epi32(r0, r1);
+	__m128i t1 = _mm_unpacklo_epi32(r2, r3);
+	__m128i t2 = _mm_unpackhi_epi32(r0, r1);
+	__m128i t3 = _mm_unpackhi_epi32(r2, r3);
+
+	_mm_storeu_si128((__m128i*)(dst + 0 * dst_stride), _mm_unpacklo_epi64(t0, t1));
+	_mm_storeu_si128((__m128i*)(dst + 1 * dst_stride), _mm_unpackhi_epi64(t0, t1));
+	_mm_storeu_si128((__m128i*)(dst + 2 * dst_stride), _mm_unpacklo_epi64(t2, t3));
+	_mm_storeu_si128((__m128i*)(dst + 3 * dst_stride), _mm_unpackhi_epi64(t2, t3));
+}
+#endif
+
+void TransposeColorBuffer(const uint32_t* src, uint32_t* dst, int dst_pitch, int width, int height)
+{
+	const size_t dst_stride = dst_pitch / sizeof(uint32_t);
+	const int block = 8;
+
+	for (int by = 0; by < height; by += block)
+	{
+		for (int bx = 0; bx < width; bx += block)
+		{
+			const uint32_t* src_block = src + ((size_t)height * bx) + by;
+			uint32_t* dst_block = dst + (dst_stride * by) + bx;
+
+#ifdef SDL_SSE2_INTRINSICS
+			if (bx + block <= width && by + block <= height)
+			{
+				// 8x8 block as four 4x4 register transposes
+				Transpose4x4(src_block, height, dst_block, dst_stride);
+				Transpose4x4(src_block + 4, height, dst_block + 4 * dst_stride, dst_stride);
+				Transpose4x4(src_block + 4 * (size_t)height, height, dst_block + 4, dst_stride);
+				Transpose4x4(src_block + 4 * (size_t)height + 4, height, dst_block + 4 * dst_stride + 4, dst_stride);
+				continue;
+			}
+#endif
+			int w = SDL_min(block, width - bx);
+			int h = SDL_min(block, height - by);
+			for (int y = 0; y < h; y++)
+			{
+				for (int x = 0; x < w; x++)
+				{
+					dst_block[(dst_stride * y) + x] = src_block[((size_t)height * x) + y];
+				}
+			}
+		}
+	}
+}
+
+void ExpandIndexedColorBuffer(const uint8_t* src, uint32_t* dst, int dst_pitch, int width, int height, const uint32_t* pal)
+{
+	for (int y = 0; y < height; y++)
+	{
+		const uint8_t* src_row = src + ((size_t)width * y);
+		uint32_t* dst_row = (uint32_t*)((uint8_t*)dst + (size_t)dst_pitch * y);
+		int x = 0;
+
+#ifdef SDL_SSE2_INTRINSICS
+		// no gather in SSE2, the lookups stay scalar but the texture sees full 16 byte stores
+		for (; x + 4 <= width; x += 4)
+		{
+			_mm_storeu_si128((__m128i*)(dst_row + x), _mm_setr_epi32(
+				(int)pal[src_row[x + 0]], (int)pal[src_row[x + 1]],
+				(int)pal[src_row[x + 2]], (int)pal[src_row[x + 3]]));
+		}
+#endif
+		for (; x < width; x++)
+		{
+			dst_row[x] = pal[src_row[x]];
+		}
+	}
+}
+
+void Render3DProjectWallColumns(int first_column, int last_column)
+{
+	int64_t pixels_written = 0;
+	for (int i = first_column; i < last_column; i++)
+	{
+		float ray_distance = rays[i].min_intersection_dist;
+		float corrected_distance = ray_distance * cosf(rays[i].rotation_angle - player.rotation_angle);
+		float distance_proj_plane = (render_width / 2) / tan(FOV_ANGLE / 2);
+		float projected_wall_height = (TILE_SIZE / corrected_distance) * distance_proj_plane;
+
+		int wallStripHeight = (int)projected_wall_height;
+
+		int wallTopPixel = (render_height / 2) - (wallStripHeight / 2);
+		wallTopPixel = wallTopPixel < 0 ? 0 : wallTopPixel;
+
+		int wallBottomPixel = (render_height / 2) + (wallStripHeight / 2);
+		wallBottomPixel = wallBottomPixel > render_height ? render_height : wallBottomPixel;
+
+		int band = ColormapBand(ray_distance);
+		depth_buffer[i] = corrected_distance;
+		if (ray_stats_enabled)
+			ray_stats[i].pixels = (uint16_t)SDL_max(wallBottomPixel - wallTopPixel, 0);
+		pixels_written += SDL_max(wallBottomPixel - wallTopPixel, 0);
+		if (overdraw_view)
+			CountOverdraw(i, wallTopPixel, wallBottomPixel);
+
+		if (indexed_color_buffer)
+		{
+			uint8_t wall_index = colormap_indices[rays[i].was_vertical_hit][band][rays[i].wall_type];
+			uint8_t* pixels = IndexedColorBuffer();
+			for (int y = wallTopPixel; y < wallBottomPixel; y++)
+			{
+				pixels[(render_width * y) + i] = wall_index;
+			}
+			continue;
+		}
+
+		uint32_t wall_color = colormap[rays[i].was_vertical_hit][band][rays[i].wall_type];
+
+		if (color_buffer_layout == ColorBufferLayout::COLUMN_MAJOR)
+		{
+			uint32_t* column = &color_buffer[(render_height * i)];
+			for (int y = wallTopPixel; y < wallBottomPixel; y++)
+			{
+				column[y] = wall_color;
+			}
+		}
+		else
+		{
+			for (int y = wallTopPixel; y < wallBottomPixel; y++)
+			{
+				color_buffer[(color_buffer_stride * y) + i] = wall_color;
+			}
+		}
+	}
+	CountPass(PASS_WALLS, pixels_written, pixels_written * ColorBufferBytesPerPixel());
+}
+
+void Render3DProjectWalls()
+{
+	Render3DProjectWallColumns(0, num_rays);
+}
+/////////////////////////////////////////////////////////
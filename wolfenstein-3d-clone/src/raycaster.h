@@ -0,0 +1,433 @@
+﻿#pragma once
+
+// raycaster core: map, doors, player, rays, colormap and the color buffer kernels. nothing in
+// here touches an SDL_Renderer or SDL_Texture, so the game and the microbenchmarks share it.
+// definitions are in raycaster.cpp
+#include <cmath>
+#include <SDL3/SDL.h>
+
+#define TILE_SIZE 64
+
+#define TILES_COL_NUM 20
+#define TILE_ROW_NUM 13
+
+#define WINDOW_WIDTH (TILES_COL_NUM * TILE_SIZE)
+#define WINDOW_HEIGHT (TILE_ROW_NUM * TILE_SIZE)
+
+#define MAP_SCALING_FACTOR 0.3125f // 20 pixels per tile, the cached minimap is drawn 1:1
+
+#define PI 3.14159265359
+#define TORAD 0.01745329251
+
+extern float FOV_ANGLE;
+#define STRIP_WIDTH 1
+#define NUM_RAYS (WINDOW_WIDTH / STRIP_WIDTH)
+
+// full resolution the render buffers are sized for, follows the window pixel size
+extern int output_width;
+extern int output_height;
+
+// internal render resolution, at most output_width x output_height
+extern int render_width;
+extern int render_height;
+extern int num_rays;
+
+//////////////////// Map //////////////////////////////
+
+extern const int map[TILE_ROW_NUM][TILES_COL_NUM];
+
+// tiles whose look changed since they were last rendered into the minimap texture
+extern bool map_tile_dirty[TILE_ROW_NUM][TILES_COL_NUM];
+extern bool map_dirty; // any tile dirty
+
+inline void MarkMapTileDirty(int row, int col)
+{
+	map_tile_dirty[row][col] = true;
+	map_dirty = true;
+}
+
+///////////////////////////////////////////////////////
+
+//////////////////// Doors //////////////////////////////
+// a door cell holds a thin panel inset half a tile that slides sideways into the wall,
+// the map only marks where doors are, their state lives in doors[]
+
+#define DOOR_TILE 4
+#define MAX_DOORS 64
+#define NO_DOOR 0xFF
+#define DOOR_SLIDE_TIME 1.0f // seconds to fully open or close
+#define DOOR_HOLD_TIME 3.0f  // seconds an open door waits before closing by itself
+#define DOOR_REACH (TILE_SIZE * 1.0f)
+
+enum class DoorState : uint8_t
+{
+	CLOSED,
+	OPENING,
+	OPEN,
+	CLOSING,
+};
+
+struct Door
+{
+	uint8_t row, col;
+	bool vertical;   // panel lies on x = const (walls north and south), otherwise on y = const
+	DoorState state;
+	float open;      // 0 closed .. 1 slid into the wall
+	float hold;
+};
+
+extern Door doors[MAX_DOORS];
+extern int door_count;
+extern uint8_t door_index[TILE_ROW_NUM][TILES_COL_NUM]; // map cell -> doors[], NO_DOOR elsewhere
+
+void InitDoors();
+
+// distance along a unit length ray to the door panel, negative when the ray
+// leaves the cell first or slips through the open part
+float RayToDoorDistance(const Door& door, float x, float y, float rdx, float rdy);
+
+// collision, a point with radius only passes once it fits into the open part
+bool DoorBlocks(const Door& door, float x, float y, float radius);
+bool DoorOccupied(const Door& door, float x, float y, float size);
+
+// opens or closes the door in reach in front of (x, y)
+void UseDoor(float x, float y, float angle);
+
+// x, y, size is the player box, doors never close on it
+void UpdateDoors(float dt, float x, float y, float size);
+
+///////////////////////////////////////////////////////
+
+//////////////////// Player /////////////////////////////
+
+struct Player
+{
+	float x = WINDOW_WIDTH * 0.5f;
+	float y = WINDOW_HEIGHT * 0.5f;
+	float size = 10.0f;
+	float rotation_angle = PI / 2.0f;
+	float walk_direction = 0; // 1 or -1 walk forward, backward
+	float turn_direction = 0; // 1 or -1 turn right, left
+	float wlak_speed = 200.0f;
+	float turn_speed = 90.0f * TORAD;
+
+	void Update(float dt);
+};
+
+extern Player player;
+
+/////////////////////////////////////////////////////////
+
+struct IntersectionData
+{
+	bool hit;
+	float x, y;
+};
+
+inline IntersectionData RayToLineIntersection(
+	float rx, float ry, float rdx, float rdy,
+	float x1, float y1, float x2, float y2)
+{
+	IntersectionData result{ false, 0.0f, 0.0f };
+
+	float sdx = x2 - x1;
+	float sdy = y2 - y1;
+
+	float denom = rdx * sdy - rdy * sdx;
+
+	if (fabs(denom) < 1e-6f)
+	{
+		return result;
+	}
+
+	float dx = x1 - rx;
+	float dy = y1 - ry;
+
+	float t = (dx * sdy - dy * sdx) / denom;
+
+	if (t >= 0.0f) 
+	{
+		result.hit = true;
+		result.x = rx + t * rdx;
+		result.y = ry + t * rdy;
+	}
+
+	return result;
+}
+
+
+
+inline float Distance(float x1, float y1, float x2, float y2)
+{
+	float dx = x2 - x1;
+	float dy = y2 - y1;
+	return std::sqrt(dx * dx + dy * dy);
+}
+
+inline float ElapsedMs(uint64_t start_counter)
+{
+	uint64_t end_counter = SDL_GetPerformanceCounter();
+	return (float)((double)(end_counter - start_counter) * 1000.0 / (double)SDL_GetPerformanceFrequency());
+}
+
+inline float NormalizeAngle(float angle)
+{
+	angle = fmodf(angle, 2.0f * PI);   // wrap within [-2π, 2π]
+	if (angle < 0)
+		angle += 2.0f * PI;            // shift to [0, 2π)
+	return angle;
+}
+
+//////////////////// Colormap ///////////////////////////
+// Doom style light diminishing: colormap[side][band][wall_type] is the wall color already
+// darkened for its side and faded towards fog_color for that distance band, so shading
+// a wall is a single table lookup and no multiplies
+
+#define COLORMAP_BANDS 32
+#define WALL_COLOR_COUNT 5
+
+extern uint32_t wall_colors[WALL_COLOR_COUNT];
+extern uint32_t fog_color;
+extern float fog_start_distance;
+extern float max_view_distance;  // rays stop traversing here, beyond it everything is fog
+extern float side_darkening;     // vertical hits, same as the old 0xFFCCCCCC
+extern uint32_t colormap[2][COLORMAP_BANDS][WALL_COLOR_COUNT];
+extern uint8_t colormap_indices[2][COLORMAP_BANDS][WALL_COLOR_COUNT]; // same table as palette indices
+extern float colormap_band_scale;
+
+// 256 color palette for the 8-bit color buffer, built from the colormap
+extern uint32_t palette[256];
+extern int palette_size;
+extern uint32_t display_palette[256]; // palette with fade and flash applied, used at expansion
+extern float palette_fade;            // 0..1 towards black
+extern float palette_flash;           // 0..1 towards red, damage flash
+
+uint32_t LerpColor(uint32_t a, uint32_t b, float t);
+
+// read only, safe to call from raster workers
+uint8_t NearestPaletteIndex(uint32_t color);
+uint8_t AddPaletteColor(uint32_t color);
+void UpdateDisplayPalette();
+void BuildColormap();
+
+inline int ColormapBand(float distance)
+{
+	int band = (int)((distance - fog_start_distance) * colormap_band_scale);
+	return SDL_clamp(band, 0, COLORMAP_BANDS - 1);
+}
+/////////////////////////////////////////////////////////
+
+//////////////////// RayStats ///////////////////////////
+// optional per ray traversal cost. only recorded while ray_stats_enabled, the plain cast is a
+// separate instantiation of Ray::Traverse so rays pay nothing when it is off
+
+enum class RayExit : uint8_t
+{
+	WALL,
+	DOOR,
+	FOG,      // passed max_view_distance
+	BEATEN,   // the other pass already had a nearer hit
+	MAP_EDGE,
+};
+
+enum class RayHeatmap
+{
+	OFF,
+	CELLS_VISITED,
+	INTERSECTION_TESTS,
+	EARLY_EXIT,
+};
+
+struct RayStats
+{
+	uint16_t cells_visited;      // map lookups over both passes
+	uint16_t intersection_tests; // grid line and door panel tests
+	uint16_t pixels;             // wall pixels the raster wrote for this column
+	RayExit horizontal_exit, vertical_exit;
+	bool early_exit;             // a pass stopped on fog or a nearer hit rather than a wall
+};
+
+#define MAX_RAY_TRACE_STEPS 128
+
+struct RayTraceStep
+{
+	int raw, col;
+	float dist;
+	bool vertical;  // which pass looked at the cell
+	int cell;       // map value, DOOR_TILE cells also record whether the panel was hit
+	bool door_hit;
+};
+
+// every cell the inspected ray looked at, in traversal order
+struct RayTrace
+{
+	int count;
+	RayTraceStep steps[MAX_RAY_TRACE_STEPS];
+};
+
+struct RayFrameTotals
+{
+	int rays, cells_visited, intersection_tests, early_exits;
+	int max_cells_visited, max_intersection_tests;
+	int64_t pixels;
+};
+
+extern bool ray_stats_enabled;
+extern RayStats* ray_stats; // one per ray, carved from the frame arena
+extern RayHeatmap ray_heatmap;
+extern bool ray_heatmap_on_view;
+extern bool ray_heatmap_on_fan;
+extern int inspected_ray;
+extern RayTrace ray_trace;
+extern RayFrameTotals ray_frame_totals;
+
+inline void TraceRayStep(RayTrace* trace, int raw, int col, float dist, bool vertical, bool door_hit)
+{
+	if (trace && trace->count < MAX_RAY_TRACE_STEPS)
+		trace->steps[trace->count++] = { raw, col, dist, vertical, map[raw][col], door_hit };
+}
+
+void SumRayStats();
+/////////////////////////////////////////////////////////
+
+//////////////////// Ray ////////////////////////////////
+struct Ray
+{
+	float x, y;
+	float rotation_angle = PI / 2.0f;
+
+	bool isRayFacingDown = 0;
+	bool isRayFacingUp = 0;
+	bool isRayFacingRight = 0;
+	bool isRayFacingLeft = 0;
+
+	float min_intersection_dist = INFINITY;
+	float intersection_x = 0.0f;
+	float intersection_y = 0.0f;
+
+	bool was_vertical_hit = false;
+	bool was_fogged = false;
+	int wall_type = 0; // map value of the wall hit, indexes wall_colors
+
+	// the ray entered a door cell, true when it met the panel and the pass can stop
+	bool HitDoor(int raw, int col, float rdx, float rdy);
+
+	void Cast();
+
+	// record instantiates the stats bookkeeping, without it the counters below are dead stores
+	template <bool record>
+	void Traverse(RayStats* stats, RayTrace* trace);
+};
+extern Ray ray;
+extern Ray* rays; // output_width / STRIP_WIDTH entries, carved from the frame arena
+
+void CastAllRays();
+
+/////////////////////////////////////////////////////////
+
+//////////////////// ColorBuffer ////////////////////////
+enum class ColorBufferLayout
+{
+	ROW_MAJOR,    // color_buffer[(color_buffer_stride * y) + x], drawn straight into the locked texture
+	COLUMN_MAJOR  // color_buffer[(render_height * x) + y], wall strips are contiguous
+};
+
+extern uint32_t* color_buffer;           // locked texture pixels (row major) or color_buffer_memory (column major)
+extern uint32_t* color_buffer_memory[2]; // [0] backs the serial path, both alternate when frames are pipelined
+extern int color_buffer_stride;          // pixels between rows, the texture pitch may be padded
+extern ColorBufferLayout color_buffer_layout;
+extern float* depth_buffer;              // perpendicular wall distance per column, sprites clip against it
+
+// 8-bit mode: color_buffer_memory holds one palette index per pixel (row major, render_width
+// bytes per row) and is expanded through display_palette into the texture on upload
+extern bool indexed_color_buffer;
+
+inline uint8_t* IndexedColorBuffer()
+{
+	return (uint8_t*)color_buffer;
+}
+
+//////////////////// PassCounters ///////////////////////
+// pixels written and bytes touched by every raster pass of one frame, counted per column or
+// span and added once per slice so raster workers only take pass_lock a few times a frame.
+// with overdraw_view set every pass also bumps a per pixel write count and the frame shows
+// those counts instead of the scene
+
+enum RasterPass
+{
+	PASS_CLEAR,
+	PASS_WALLS,
+	PASS_SPRITES,
+	PASS_UPLOAD,
+	PASS_COUNT
+};
+
+extern const char* raster_pass_names[PASS_COUNT];
+
+struct PassCounter
+{
+	int64_t pixels, bytes;
+};
+
+// 64-bit totals, a heavy overdraw frame at high resolution touches more than 2 GB
+extern SDL_SpinLock pass_lock;
+extern PassCounter pass_totals[PASS_COUNT];   // the raster in flight, guarded by pass_lock
+extern PassCounter pass_counters[PASS_COUNT]; // the last finished raster, upload included
+
+extern bool overdraw_view;
+extern uint8_t* overdraw_buffer; // render_width x render_height write counts, row major, carved from the frame arena
+
+inline int ColorBufferBytesPerPixel()
+{
+	return indexed_color_buffer ? 1 : (int)sizeof(uint32_t);
+}
+
+inline void CountPass(RasterPass pass, int64_t pixels, int64_t bytes)
+{
+	SDL_LockSpinlock(&pass_lock);
+	pass_totals[pass].pixels += pixels;
+	pass_totals[pass].bytes += bytes;
+	SDL_UnlockSpinlock(&pass_lock);
+}
+
+// call before a raster starts, keeps what the previous one counted
+void ResetPassCounters();
+
+#define OVERDRAW_COLOR_COUNT 7
+
+// black for untouched, then blue, green, yellow, orange, red and white for 6 or more writes.
+// BuildColormap gives the ramp its own palette entries so the 8-bit view shows it exactly
+extern const uint32_t overdraw_colors[OVERDRAW_COLOR_COUNT];
+extern uint8_t overdraw_color_indices[OVERDRAW_COLOR_COUNT];
+
+// saturates at 255, a wrapped count would show the worst columns as untouched
+inline void CountOverdraw(int x, int y_first, int y_last)
+{
+	for (int y = y_first; y < y_last; y++)
+	{
+		uint8_t& count = overdraw_buffer[(render_width * y) + x];
+		if (count != 255)
+			count++;
+	}
+}
+
+// replaces the drawn columns [first_column, last_column) with their write counts
+void ResolveOverdrawColumns(int first_column, int last_column);
+
+/////////////////////////////////////////////////////////
+
+// clears columns [first_column, last_column) so raster workers can each own a slice of the screen
+void ClearColorBufferColumns(uint32_t color, int first_column, int last_column);
+void ClearColorBuffer(uint32_t color);
+
+// column-major color buffer -> row-major pixels, dst_pitch is in bytes (texture rows may be padded)
+void TransposeColorBuffer(const uint32_t* src, uint32_t* dst, int dst_pitch, int width, int height);
+
+// palette expansion into row-major pixels, dst_pitch is in bytes
+void ExpandIndexedColorBuffer(const uint8_t* src, uint32_t* dst, int dst_pitch, int width, int height, const uint32_t* pal);
+
+// draws wall strips for columns [first_column, last_column)
+void Render3DProjectWallColumns(int first_column, int last_column);
+void Render3DProjectWalls();
+
+/////////////////////////////////////////////////////////
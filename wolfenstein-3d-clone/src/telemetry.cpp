@@ -0,0 +1,97 @@
+﻿#include "telemetry.h"
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+bool OpenTelemetryFile(TelemetryFile& telemetry, const char* path, uint32_t capacity)
+{
+	size_t size = sizeof(TelemetryHeader) + sizeof(TelemetryRecord) * (size_t)capacity;
+	void* memory = nullptr;
+
+#ifdef _WIN32
+	telemetry.file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (telemetry.file == INVALID_HANDLE_VALUE)
+	{
+		telemetry.file = nullptr;
+		return false;
+	}
+
+	telemetry.mapping = CreateFileMappingA(telemetry.file, nullptr, PAGE_READWRITE, (DWORD)((uint64_t)size >> 32), (DWORD)size, nullptr);
+	if (telemetry.mapping)
+		memory = MapViewOfFile(telemetry.mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+	if (!memory)
+	{
+		if (telemetry.mapping)
+			CloseHandle(telemetry.mapping);
+		CloseHandle(telemetry.file);
+		telemetry.mapping = nullptr;
+		telemetry.file = nullptr;
+		return false;
+	}
+#else
+	telemetry.fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (telemetry.fd < 0)
+		return false;
+
+	if (ftruncate(telemetry.fd, (off_t)size) == 0)
+		memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, telemetry.fd, 0);
+	if (!memory || memory == MAP_FAILED)
+	{
+		close(telemetry.fd);
+		telemetry.fd = -1;
+		return false;
+	}
+#endif
+
+	SDL_memset(memory, 0, size);
+	telemetry.size = size;
+	telemetry.header = (TelemetryHeader*)memory;
+	telemetry.records = (TelemetryRecord*)(telemetry.header + 1);
+	telemetry.write_count = 0;
+
+	TelemetryHeader& header = *telemetry.header;
+	header.version = TELEMETRY_VERSION;
+	header.header_size = sizeof(TelemetryHeader);
+	header.record_size = sizeof(TelemetryRecord);
+	header.capacity = capacity;
+	header.counter_frequency = SDL_GetPerformanceFrequency();
+	header.start_counter = SDL_GetPerformanceCounter();
+	header.write_count = 0;
+	// the magic goes in last, a reader never sees a half written header
+	SDL_MemoryBarrierRelease();
+	SDL_memcpy(header.magic, TELEMETRY_MAGIC, sizeof(header.magic));
+	return true;
+}
+
+void CloseTelemetryFile(TelemetryFile& telemetry)
+{
+	if (!telemetry.header)
+		return;
+
+#ifdef _WIN32
+	FlushViewOfFile(telemetry.header, telemetry.size);
+	UnmapViewOfFile(telemetry.header);
+	CloseHandle(telemetry.mapping);
+	CloseHandle(telemetry.file);
+	telemetry.mapping = nullptr;
+	telemetry.file = nullptr;
+#else
+	msync(telemetry.header, telemetry.size, MS_SYNC);
+	munmap(telemetry.header, telemetry.size);
+	close(telemetry.fd);
+	telemetry.fd = -1;
+#endif
+	telemetry.header = nullptr;
+	telemetry.records = nullptr;
+}
@@ -0,0 +1,48 @@
+﻿#pragma once
+
+// per frame telemetry for soak runs: a ring of TelemetryRecord in a file that is mapped shared
+// into the process. the frame loop only stores into the mapping, the kernel writes the pages
+// back on its own, so there is no io, no syscall and no allocation per frame and whatever was
+// stored survives the game crashing. telemetry-reader follows the file live or reads it after
+#include <SDL3/SDL.h>
+#include "telemetry_format.h"
+
+struct TelemetryFile
+{
+	TelemetryHeader* header = nullptr;
+	TelemetryRecord* records = nullptr;
+	size_t size = 0;
+	uint64_t write_count = 0;
+#ifdef _WIN32
+	void* file = nullptr;    // HANDLEs, windows.h stays in telemetry.cpp
+	void* mapping = nullptr;
+#else
+	int fd = -1;
+#endif
+};
+
+// creates (or truncates) path, sizes it for capacity records and maps it,
+// every page is touched here so the frame loop never takes a fault that reads from disk
+bool OpenTelemetryFile(TelemetryFile& telemetry, const char* path, uint32_t capacity);
+
+// the slot for the next record, its sequence is cleared so a crash mid write leaves it torn, not stale
+inline TelemetryRecord& BeginTelemetryRecord(TelemetryFile& telemetry)
+{
+	TelemetryRecord& record = telemetry.records[telemetry.write_count % telemetry.header->capacity];
+	record.sequence = 0;
+	SDL_MemoryBarrierRelease();
+	return record;
+}
+
+inline void EndTelemetryRecord(TelemetryFile& telemetry, TelemetryRecord& record)
+{
+	telemetry.write_count++;
+	SDL_MemoryBarrierRelease();
+	record.sequence = telemetry.write_count;
+	SDL_MemoryBarrierRelease();
+	telemetry.header->write_count = telemetry.write_count;
+}
+
+// flushes the mapping to disk, only needed against losing the machine, the page cache already
+// outlives the process
+void CloseTelemetryFile(TelemetryFile& telemetry);
@@ -0,0 +1,45 @@
+﻿#pragma once
+
+// on disk layout of the telemetry file, shared by the game (telemetry.h) and telemetry-reader.
+// a header followed by a ring of fixed size records. the game maps the file and writes with
+// plain stores: a record's sequence is zeroed, the fields filled, then sequence is set to the
+// number of records written so far and finally the header's write_count moves. record n lives
+// in slot (n - 1) % capacity, one whose sequence does not match was overwritten or torn by a
+// crash and is skipped by the reader
+#include <cstdint>
+
+#define TELEMETRY_MAGIC "WOLFTLM"
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_RECORDS 262144 // a bit over an hour at 60 fps
+
+struct TelemetryHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t record_size;
+	uint32_t capacity;           // records in the ring
+	uint64_t counter_frequency;  // ticks per second of the timestamps
+	uint64_t start_counter;      // timestamp when the file was opened
+	volatile uint64_t write_count; // records ever written, the newest is at (write_count - 1) % capacity
+	uint8_t pad[16];
+};
+
+struct TelemetryRecord
+{
+	volatile uint64_t sequence;  // records written including this one, 0 while it is written
+	uint64_t timestamp;          // frame start
+	int32_t frame;
+	float frame_ms, cast_ms, raster_ms, upload_ms;
+	float x, y, angle;           // player, angle in radians
+	int32_t render_width, render_height;
+	float resolution_scale;
+	int32_t allocations;         // heap allocations this frame
+	int64_t live_bytes;          // tracked heap in use
+	int64_t pixels_written, bytes_touched;
+	int32_t visible_sprites;
+	int32_t hitch_dumps;
+};
+
+static_assert(sizeof(TelemetryHeader) == 64, "telemetry header layout changed, bump TELEMETRY_VERSION");
+static_assert(sizeof(TelemetryRecord) == 96, "telemetry record layout changed, bump TELEMETRY_VERSION");